@@ -17,15 +17,616 @@ struct type_index<T, First, Rest...> {
  */
 struct Descriptor {
     const char* name;
+    uint32_t binding;
     VkDescriptorType type;
     uint32_t count;
     uint32_t byteSize;
     VkShaderStageFlags stages = VK_SHADER_STAGE_ALL_GRAPHICS;
+    VkDescriptorBindingFlags bindingFlags = 0; // Needs the matching VK_EXT_descriptor_indexing features
 };
 
+/* Every descriptor type the generator can emit, DescriptorTypeIndex maps a type to its position */
+inline constexpr std::array<VkDescriptorType, 12> AllDescriptorTypes = {
+        VK_DESCRIPTOR_TYPE_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+        VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+};
+constexpr size_t DescriptorTypeIndex(VkDescriptorType type) {
+    // The core types are contiguous, starting at 0
+    return type == VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR ? 11 : static_cast<size_t>(type);
+}
+typedef std::array<uint32_t, AllDescriptorTypes.size()> DescriptorTypeCounts;
+
 struct DescriptorCounts {
     uint32_t numSamplers;
     uint32_t numBuffers;
+    DescriptorTypeCounts countsByType{}; // Indexed by DescriptorTypeIndex
+};
+
+/* Evaluated at compile time against the static Descriptors table of every generated set */
+template <size_t N>
+constexpr std::array<VkDescriptorSetLayoutBinding, N> MakeLayoutBindings(const std::array<Descriptor, N>& descriptors) {
+    std::array<VkDescriptorSetLayoutBinding, N> setBindings{};
+    for (size_t i = 0; i < N; i++) {
+        setBindings[i] = VkDescriptorSetLayoutBinding{
+                .binding = descriptors[i].binding,
+                .descriptorType = descriptors[i].type,
+                .descriptorCount = descriptors[i].count,
+                .stageFlags = descriptors[i].stages,
+                .pImmutableSamplers = nullptr,
+        };
+    }
+    return setBindings;
+}
+template <size_t N>
+constexpr std::array<VkDescriptorBindingFlags, N> MakeBindingFlags(const std::array<Descriptor, N>& descriptors) {
+    std::array<VkDescriptorBindingFlags, N> bindingFlags{};
+    for (size_t i = 0; i < N; i++)
+        bindingFlags[i] = descriptors[i].bindingFlags;
+    return bindingFlags;
+}
+template <size_t N>
+constexpr uint32_t CountDescriptorsWithType(const std::array<Descriptor, N>& descriptors, VkDescriptorType descriptorType) {
+    uint32_t count = 0;
+    for (const Descriptor& desc : descriptors)
+        if (desc.type == descriptorType)
+            count += desc.count;
+    return count;
+}
+template <size_t N>
+constexpr DescriptorTypeCounts CountDescriptorsByType(const std::array<Descriptor, N>& descriptors) {
+    DescriptorTypeCounts counts{};
+    for (const Descriptor& desc : descriptors)
+        counts[DescriptorTypeIndex(desc.type)] += desc.count;
+    return counts;
+}
+
+/**
+ * Pool sizes for allocating MAX_SETS_PER_FRAME of every one of the set types T, computed at compile time.
+ * Only types used by at least one set get an entry, PoolSizes can be handed to VkDescriptorPoolCreateInfo directly.
+ */
+template <uint32_t MAX_SETS_PER_FRAME, typename... T>
+struct DescriptorPoolSizes {
+private:
+    static constexpr DescriptorTypeCounts CountTotals() {
+        DescriptorTypeCounts totals{};
+        for (const DescriptorTypeCounts& setCounts : { DescriptorTypeCounts{}, CountDescriptorsByType(T::Descriptors)... })
+            for (size_t i = 0; i < totals.size(); i++)
+                totals[i] += setCounts[i] * MAX_SETS_PER_FRAME;
+        return totals;
+    }
+    static constexpr size_t CountUsedTypes() {
+        size_t used = 0;
+        for (uint32_t total : CountTotals())
+            if (total > 0) used++;
+        return used;
+    }
+public:
+    static constexpr DescriptorTypeCounts Totals = CountTotals();
+    static constexpr uint32_t MaxSets = MAX_SETS_PER_FRAME * sizeof...(T);
+    /* Sets with update after bind bindings can only be allocated from a pool created for them */
+    static constexpr VkDescriptorPoolCreateFlags Flags =
+            (false || ... || ((T::LayoutFlags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT) != 0))
+            ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0;
+    static constexpr std::array<VkDescriptorPoolSize, CountUsedTypes()> PoolSizes = [] {
+        std::array<VkDescriptorPoolSize, CountUsedTypes()> poolSizes{};
+        size_t used = 0;
+        for (size_t i = 0; i < Totals.size(); i++)
+            if (Totals[i] > 0) poolSizes[used++] = VkDescriptorPoolSize{ AllDescriptorTypes[i], Totals[i] };
+        return poolSizes;
+    }();
+};
+
+/* POOL_SIZES is a DescriptorPoolSizes<...>, one pool that fits all of its sets without reallocation */
+template <typename POOL_SIZES>
+VkDescriptorPool CreateDescriptorPool(VkDevice device, VkDescriptorPoolCreateFlags flags = 0) {
+    VkDescriptorPoolCreateInfo createInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .flags = flags | POOL_SIZES::Flags,
+            .maxSets = POOL_SIZES::MaxSets,
+            .poolSizeCount = static_cast<uint32_t>(POOL_SIZES::PoolSizes.size()),
+            .pPoolSizes = POOL_SIZES::PoolSizes.data(),
+    };
+    VkDescriptorPool pool{};
+    vkCreateDescriptorPool(device, &createInfo, nullptr, &pool);
+    return pool;
+}
+
+/* flags and setBindings of the generated sets are compile time constants, pBindings can point straight at them */
+template <size_t N>
+VkDescriptorSetLayout CreateDescriptorSetLayout(VkDevice device, VkDescriptorSetLayoutCreateFlags layoutFlags,
+                                                const std::array<VkDescriptorSetLayoutBinding, N>& setBindings,
+                                                const std::array<VkDescriptorBindingFlags, N>& bindingFlags) {
+    // Only chained when some binding has flags, so sets without any don't need descriptor indexing
+    bool anyBindingFlags = false;
+    for (VkDescriptorBindingFlags flags : bindingFlags) anyBindingFlags |= flags != 0;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+            .bindingCount = static_cast<uint32_t>(N),
+            .pBindingFlags = bindingFlags.data(),
+    };
+    VkDescriptorSetLayoutCreateInfo createInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext = anyBindingFlags ? &bindingFlagsInfo : nullptr,
+            .flags = layoutFlags,
+            .bindingCount = static_cast<uint32_t>(N),
+            .pBindings = setBindings.data(),
+
+    };
+    VkDescriptorSetLayout setLayout{};
+    vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &setLayout);
+    return setLayout;
+}
+
+/* FNV-1a over everything that tells two layouts apart, evaluated at compile time for the generated sets */
+template <size_t N>
+constexpr uint64_t HashDescriptorSetLayout(VkDescriptorSetLayoutCreateFlags layoutFlags,
+                                           const std::array<VkDescriptorSetLayoutBinding, N>& setBindings,
+                                           const std::array<VkDescriptorBindingFlags, N>& bindingFlags) {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t value) { hash = (hash ^ value) * 1099511628211ull; };
+    mix(layoutFlags);
+    mix(N);
+    for (size_t i = 0; i < N; i++) {
+        mix(setBindings[i].binding);
+        mix(static_cast<uint64_t>(setBindings[i].descriptorType));
+        mix(setBindings[i].descriptorCount);
+        mix(setBindings[i].stageFlags);
+        mix(bindingFlags[i]);
+    }
+    return hash;
+}
+
+/**
+ * Creates every distinct layout once, however many set types (or generated aliases of a set) ask for it, so the
+ * pipelines using them get identical, compatible VkDescriptorSetLayouts. Owns the layouts, Get can be called from any
+ * thread. Keyed by HashDescriptorSetLayout, equal hashes are compared in full.
+ */
+class DescriptorSetLayoutCache {
+public:
+    explicit DescriptorSetLayoutCache(VkDevice device) : m_device(device) {}
+    ~DescriptorSetLayoutCache() {
+        for (const auto& [hash, entry] : m_entries) vkDestroyDescriptorSetLayout(m_device, entry.layout, nullptr);
+    }
+    DescriptorSetLayoutCache(const DescriptorSetLayoutCache&) = delete;
+    DescriptorSetLayoutCache& operator=(const DescriptorSetLayoutCache&) = delete;
+
+    template <typename SET>
+    VkDescriptorSetLayout Get() {
+        static constexpr uint64_t hash = HashDescriptorSetLayout(SET::LayoutFlags, SET::LayoutBindings, SET::BindingFlags);
+        return Get(hash, SET::LayoutFlags, SET::LayoutBindings, SET::BindingFlags);
+    }
+    /** setBindings and bindingFlags must be static storage, they are kept to compare against */
+    template <size_t N>
+    VkDescriptorSetLayout Get(uint64_t hash, VkDescriptorSetLayoutCreateFlags layoutFlags,
+                              const std::array<VkDescriptorSetLayoutBinding, N>& setBindings,
+                              const std::array<VkDescriptorBindingFlags, N>& bindingFlags) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto [begin, end] = m_entries.equal_range(hash);
+        for (auto it = begin; it != end; ++it)
+            if (it->second.Matches(layoutFlags, setBindings.data(), bindingFlags.data(), N)) return it->second.layout;
+        VkDescriptorSetLayout layout = CreateDescriptorSetLayout(m_device, layoutFlags, setBindings, bindingFlags);
+        m_entries.emplace(hash, Entry{ layoutFlags, setBindings.data(), bindingFlags.data(), N, layout });
+        return layout;
+    }
+    size_t GetLayoutCount() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+private:
+    struct Entry {
+        VkDescriptorSetLayoutCreateFlags layoutFlags;
+        const VkDescriptorSetLayoutBinding* setBindings;
+        const VkDescriptorBindingFlags* bindingFlags;
+        size_t bindingCount;
+        VkDescriptorSetLayout layout;
+
+        bool Matches(VkDescriptorSetLayoutCreateFlags otherLayoutFlags, const VkDescriptorSetLayoutBinding* otherBindings,
+                     const VkDescriptorBindingFlags* otherBindingFlags, size_t otherCount) const {
+            if (layoutFlags != otherLayoutFlags || bindingCount != otherCount) return false;
+            for (size_t i = 0; i < bindingCount; i++) {
+                const VkDescriptorSetLayoutBinding& a = setBindings[i];
+                const VkDescriptorSetLayoutBinding& b = otherBindings[i];
+                if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount ||
+                    a.stageFlags != b.stageFlags || bindingFlags[i] != otherBindingFlags[i]) return false;
+            }
+            return true;
+        }
+    };
+    VkDevice m_device;
+    mutable std::mutex m_mutex;
+    std::unordered_multimap<uint64_t, Entry> m_entries;
+};
+
+/* variableDescriptorCount sizes the VARIABLE_DESCRIPTOR_COUNT binding of the layout, if it has one */
+inline VkDescriptorSet AllocateDescriptorSet(VkDevice device, VkDescriptorPool pool, VkDescriptorSetLayout layout,
+                                             uint32_t variableDescriptorCount = 0) {
+    VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+            .descriptorSetCount = 1,
+            .pDescriptorCounts = &variableDescriptorCount,
+    };
+    VkDescriptorSetAllocateInfo allocateInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext = variableDescriptorCount ? &variableCountInfo : nullptr,
+            .descriptorPool = pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout,
+    };
+    VkDescriptorSet set{};
+    vkAllocateDescriptorSets(device, &allocateInfo, &set);
+    return set;
+}
+
+/* From the TemplateEntries of a generated set, VK_NULL_HANDLE if it has none (only bindless bindings) */
+template <size_t N>
+VkDescriptorUpdateTemplate CreateDescriptorUpdateTemplate(VkDevice device, VkDescriptorSetLayout layout,
+                                                          const std::array<VkDescriptorUpdateTemplateEntry, N>& entries) {
+    if (N == 0) return {};
+    VkDescriptorUpdateTemplateCreateInfo createInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
+            .descriptorUpdateEntryCount = static_cast<uint32_t>(N),
+            .pDescriptorUpdateEntries = entries.data(),
+            .templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+            .descriptorSetLayout = layout,
+    };
+    VkDescriptorUpdateTemplate updateTemplate{};
+    vkCreateDescriptorUpdateTemplate(device, &createInfo, nullptr, &updateTemplate);
+    return updateTemplate;
+}
+
+/* Writes every descriptor of a SET in one call, updateTemplate comes from SET::TemplateEntries */
+template <typename SET>
+void WriteDescriptorSet(VkDevice device, VkDescriptorSet set, VkDescriptorUpdateTemplate updateTemplate,
+                        const typename SET::Payload& payload) {
+    if (updateTemplate) vkUpdateDescriptorSetWithTemplate(device, set, updateTemplate, &payload);
+}
+
+/**
+ * Per-frame linear sub-allocator over one persistently mapped uniform buffer split into frameCount regions, for the
+ * UNIFORM_BUFFER_DYNAMIC bindings. Their descriptors are written once (buffer, offset 0, range sizeof(block)), every
+ * draw then copies its block into a fresh slice and binds with the slice's offset as its dynamic offset.
+ * Push can be called from several recording threads at once.
+ */
+class UniformRingBuffer {
+public:
+    static constexpr uint32_t INVALID_OFFSET = 0xffffffffu;
+
+    /** @param minOffsetAlignment VkPhysicalDeviceLimits::minUniformBufferOffsetAlignment, a power of two */
+    UniformRingBuffer(void* mapped, VkDeviceSize frameSize, uint32_t frameCount, VkDeviceSize minOffsetAlignment)
+        : m_mapped(static_cast<uint8_t*>(mapped)), m_alignment(minOffsetAlignment),
+          m_frameSize(AlignDown(frameSize, minOffsetAlignment)), m_frameCount(frameCount) {}
+    UniformRingBuffer(const UniformRingBuffer&) = delete;
+    UniformRingBuffer& operator=(const UniformRingBuffer&) = delete;
+
+    /** Bytes of the buffer to create and map for frameSize bytes per frame */
+    static constexpr VkDeviceSize BufferSize(VkDeviceSize frameSize, uint32_t frameCount, VkDeviceSize minOffsetAlignment) {
+        return AlignDown(frameSize, minOffsetAlignment) * frameCount;
+    }
+    /** Starts over in the region of frameIndex, whose previous slices the GPU must be done reading */
+    void BeginFrame(uint32_t frameIndex) {
+        m_frameStart = (frameIndex % m_frameCount) * m_frameSize;
+        m_used.store(0, std::memory_order_relaxed);
+    }
+    /** A slice of size bytes for this frame, nullptr (and INVALID_OFFSET) once the frame's region is full */
+    void* Allocate(VkDeviceSize size, uint32_t& outDynamicOffset) {
+        VkDeviceSize slice = AlignUp(size, m_alignment);
+        VkDeviceSize offset = m_used.fetch_add(slice, std::memory_order_relaxed);
+        if (offset + slice > m_frameSize) {
+            outDynamicOffset = INVALID_OFFSET;
+            return nullptr;
+        }
+        outDynamicOffset = static_cast<uint32_t>(m_frameStart + offset);
+        return m_mapped + m_frameStart + offset;
+    }
+    /** Copies block into a new slice, the result goes into pDynamicOffsets */
+    template <typename T>
+    uint32_t Push(const T& block) {
+        uint32_t dynamicOffset = INVALID_OFFSET;
+        if (void* slice = Allocate(sizeof(T), dynamicOffset)) std::memcpy(slice, &block, sizeof(T));
+        return dynamicOffset;
+    }
+    VkDeviceSize GetUsedBytes() const { return std::min(m_used.load(std::memory_order_relaxed), m_frameSize); }
+private:
+    static constexpr VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+    static constexpr VkDeviceSize AlignDown(VkDeviceSize value, VkDeviceSize alignment) { return value & ~(alignment - 1); }
+
+    uint8_t* m_mapped;
+    VkDeviceSize m_alignment;
+    VkDeviceSize m_frameSize;
+    uint32_t m_frameCount;
+    VkDeviceSize m_frameStart = 0;
+    std::atomic<VkDeviceSize> m_used{ 0 };
+};
+
+/* Binds set as set number setIndex, with one dynamic offset per dynamic descriptor of SET (see DynamicOffsetCount) */
+template <typename SET>
+void BindDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout,
+                       uint32_t setIndex, VkDescriptorSet set,
+                       const std::array<uint32_t, SET::DynamicOffsetCount>& dynamicOffsets = {}) {
+    vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, setIndex, 1, &set, SET::DynamicOffsetCount,
+                            dynamicOffsets.data());
+}
+
+/**
+ * Lock-free free list over the CAPACITY elements of a bindless array binding, Allocate and Free can be called from
+ * any thread. The head carries a tag bumped on every change, so a slot popped and pushed back while another thread
+ * is mid-pop can't be handed out twice.
+ */
+template <uint32_t CAPACITY>
+class BindlessSlotAllocator {
+public:
+    static constexpr uint32_t INVALID_SLOT = 0xffffffffu;
+    static constexpr uint32_t Capacity = CAPACITY;
+
+    BindlessSlotAllocator() {
+        for (uint32_t i = 0; i < CAPACITY; i++)
+            m_next[i].store(i + 1 < CAPACITY ? i + 1 : INVALID_SLOT, std::memory_order_relaxed);
+        m_head.store(PackHead(CAPACITY ? 0 : INVALID_SLOT, 0), std::memory_order_release);
+    }
+    BindlessSlotAllocator(const BindlessSlotAllocator&) = delete;
+    BindlessSlotAllocator& operator=(const BindlessSlotAllocator&) = delete;
+
+    /** The array element to write the descriptor to, INVALID_SLOT when every slot is in use */
+    uint32_t Allocate() {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t slot = static_cast<uint32_t>(head);
+            if (slot == INVALID_SLOT) return INVALID_SLOT;
+            uint32_t next = m_next[slot].load(std::memory_order_relaxed);
+            if (m_head.compare_exchange_weak(head, PackHead(next, static_cast<uint32_t>(head >> 32) + 1),
+                                             std::memory_order_acquire, std::memory_order_acquire))
+                return slot;
+        }
+    }
+    /** Only once no frame in flight still reads the slot */
+    void Free(uint32_t slot) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        do {
+            m_next[slot].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        } while (!m_head.compare_exchange_weak(head, PackHead(slot, static_cast<uint32_t>(head >> 32) + 1),
+                                               std::memory_order_release, std::memory_order_relaxed));
+    }
+private:
+    static constexpr uint64_t PackHead(uint32_t slot, uint32_t tag) { return (static_cast<uint64_t>(tag) << 32) | slot; }
+    std::array<std::atomic<uint32_t>, CAPACITY> m_next;
+    std::atomic<uint64_t> m_head;
+};
+
+/* Points one element of a bindless array binding at an image, the set must come from an update after bind pool */
+inline void WriteBindlessSlot(VkDevice device, VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+                              uint32_t slot, const VkDescriptorImageInfo& imageInfo) {
+    VkWriteDescriptorSet write {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = set,
+            .dstBinding = binding,
+            .dstArrayElement = slot,
+            .descriptorCount = 1,
+            .descriptorType = type,
+            .pImageInfo = &imageInfo,
+    };
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+/* Same, for a buffer */
+inline void WriteBindlessSlot(VkDevice device, VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+                              uint32_t slot, const VkDescriptorBufferInfo& bufferInfo) {
+    VkWriteDescriptorSet write {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = set,
+            .dstBinding = binding,
+            .dstArrayElement = slot,
+            .descriptorCount = 1,
+            .descriptorType = type,
+            .pBufferInfo = &bufferInfo,
+    };
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+
+/* Which VkWriteDescriptorSet array a descriptor type is written from */
+enum class DescriptorInfoKind : uint8_t { IMAGE, BUFFER, TEXEL_BUFFER, NONE };
+constexpr DescriptorInfoKind GetDescriptorInfoKind(VkDescriptorType type) {
+    switch (type) {
+        case VK_DESCRIPTOR_TYPE_SAMPLER:
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+            return DescriptorInfoKind::IMAGE;
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+            return DescriptorInfoKind::BUFFER;
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+            return DescriptorInfoKind::TEXEL_BUFFER;
+        default: // Acceleration structures are written through a pNext chain
+            return DescriptorInfoKind::NONE;
+    }
+}
+
+/**
+ * Writes collected from any number of sets, handed to the driver in a single vkUpdateDescriptorSets.
+ * Keep one around and reuse it every frame, it holds on to its capacity.
+ */
+class DescriptorWriteBatch {
+public:
+    void Add(const VkWriteDescriptorSet& write) { m_writes.push_back(write); }
+    size_t GetWriteCount() const { return m_writes.size(); }
+    /** The infos the writes point at (see FramedDescriptorSet::CollectWrites) must still be alive. @return writes made */
+    uint32_t Submit(VkDevice device) {
+        uint32_t writeCount = static_cast<uint32_t>(m_writes.size());
+        if (writeCount) vkUpdateDescriptorSets(device, writeCount, m_writes.data(), 0, nullptr);
+        m_writes.clear();
+        return writeCount;
+    }
+private:
+    std::vector<VkWriteDescriptorSet> m_writes;
+};
+
+/**
+ * FRAME_COUNT copies of a SET, one per frame in flight, so a copy is only ever written once the GPU is done with its
+ * frame. The descriptors are kept here, Set* only marks the bindings whose contents actually changed, and every copy
+ * catches up on its own dirty bindings the next time its frame is flushed. A set nothing changed in costs no writes.
+ * Array elements never Set are never written, so arrays can be filled in part without the nullDescriptor feature.
+ * Bindless (update after bind) bindings are not tracked, those are written with WriteBindlessSlot.
+ * The copies go back with their pool, which needs FRAME_COUNT times the sets of DescriptorPoolSizes.
+ */
+template <typename SET, uint32_t FRAME_COUNT>
+class FramedDescriptorSet {
+    static constexpr size_t N = SET::Descriptors.size();
+    static_assert(N <= 64, "One dirty bit per binding");
+    static_assert(FRAME_COUNT > 0);
+
+    static constexpr bool IsTracked(const Descriptor& desc, DescriptorInfoKind kind) {
+        return GetDescriptorInfoKind(desc.type) == kind && !(desc.bindingFlags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT);
+    }
+    static constexpr uint32_t CountInfos(DescriptorInfoKind kind) {
+        uint32_t count = 0;
+        for (const Descriptor& desc : SET::Descriptors)
+            if (IsTracked(desc, kind)) count += desc.count;
+        return count;
+    }
+    /* Where the descriptors of each binding start, in the array of their kind */
+    static constexpr std::array<uint32_t, N> InfoOffsets = [] {
+        std::array<uint32_t, N> offsets{};
+        std::array<uint32_t, 4> cursors{};
+        for (size_t i = 0; i < N; i++) {
+            auto kind = static_cast<size_t>(GetDescriptorInfoKind(SET::Descriptors[i].type));
+            offsets[i] = cursors[kind];
+            if (IsTracked(SET::Descriptors[i], static_cast<DescriptorInfoKind>(kind))) cursors[kind] += SET::Descriptors[i].count;
+        }
+        return offsets;
+    }();
+public:
+    typedef uint64_t DirtyMask; // Bit i is SET::Descriptors[i]
+    static constexpr uint32_t FrameCount = FRAME_COUNT;
+
+    /** Index of the descriptor called name in SET::Descriptors, for the Set* template argument */
+    static constexpr uint32_t IndexOf(std::string_view name) {
+        for (uint32_t i = 0; i < N; i++)
+            if (name == SET::Descriptors[i].name) return i;
+        return UINT32_MAX;
+    }
+
+    /* Descriptors of the VARIABLE_DESCRIPTOR_COUNT binding (see MakeBindlessBindings), 0 if the set has none */
+    static constexpr uint32_t VariableDescriptorCount = [] {
+        for (const Descriptor& desc : SET::Descriptors)
+            if (desc.bindingFlags & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT) return desc.count;
+        return 0u;
+    }();
+
+    FramedDescriptorSet(VkDevice device, VkDescriptorPool pool, VkDescriptorSetLayout layout) {
+        for (VkDescriptorSet& set : m_sets) set = AllocateDescriptorSet(device, pool, layout, VariableDescriptorCount);
+    }
+
+    VkDescriptorSet Get(uint32_t frameIndex) const { return m_sets[frameIndex % FRAME_COUNT]; }
+    DirtyMask GetDirtyMask(uint32_t frameIndex) const { return m_dirty[frameIndex % FRAME_COUNT]; }
+
+    template <uint32_t INDEX>
+    void SetImage(uint32_t element, const VkDescriptorImageInfo& imageInfo) {
+        static_assert(IsTracked(SET::Descriptors[INDEX], DescriptorInfoKind::IMAGE), "Not a tracked image descriptor");
+        assert(element < SET::Descriptors[INDEX].count);
+        VkDescriptorImageInfo& current = m_imageInfos[InfoOffsets[INDEX] + element];
+        bool& isSet = m_isImageSet[InfoOffsets[INDEX] + element];
+        if (isSet && current.sampler == imageInfo.sampler && current.imageView == imageInfo.imageView &&
+            current.imageLayout == imageInfo.imageLayout) return;
+        isSet = true;
+        current = imageInfo;
+        MarkDirty(INDEX);
+    }
+    template <uint32_t INDEX>
+    void SetBuffer(uint32_t element, const VkDescriptorBufferInfo& bufferInfo) {
+        static_assert(IsTracked(SET::Descriptors[INDEX], DescriptorInfoKind::BUFFER), "Not a tracked buffer descriptor");
+        assert(element < SET::Descriptors[INDEX].count);
+        VkDescriptorBufferInfo& current = m_bufferInfos[InfoOffsets[INDEX] + element];
+        bool& isSet = m_isBufferSet[InfoOffsets[INDEX] + element];
+        if (isSet && current.buffer == bufferInfo.buffer && current.offset == bufferInfo.offset && current.range == bufferInfo.range) return;
+        isSet = true;
+        current = bufferInfo;
+        MarkDirty(INDEX);
+    }
+    template <uint32_t INDEX>
+    void SetTexelBuffer(uint32_t element, VkBufferView bufferView) {
+        static_assert(IsTracked(SET::Descriptors[INDEX], DescriptorInfoKind::TEXEL_BUFFER), "Not a tracked texel buffer descriptor");
+        assert(element < SET::Descriptors[INDEX].count);
+        VkBufferView& current = m_texelBufferViews[InfoOffsets[INDEX] + element];
+        bool& isSet = m_isTexelBufferSet[InfoOffsets[INDEX] + element];
+        if (isSet && current == bufferView) return;
+        isSet = true;
+        current = bufferView;
+        MarkDirty(INDEX);
+    }
+
+    /**
+     * One write per run of set elements of every dirty binding of the copy of frameIndex, which is clean afterwards.
+     * The writes point into this object, submit them before changing it again.
+     * @return writes added
+     */
+    uint32_t CollectWrites(uint32_t frameIndex, DescriptorWriteBatch& batch) {
+        DirtyMask& dirty = m_dirty[frameIndex % FRAME_COUNT];
+        uint32_t writeCount = 0;
+        for (DirtyMask remaining = dirty; remaining; remaining &= remaining - 1) {
+            auto i = static_cast<uint32_t>(std::countr_zero(remaining));
+            const Descriptor& desc = SET::Descriptors[i];
+            const bool* isSet = nullptr;
+            switch (GetDescriptorInfoKind(desc.type)) {
+                case DescriptorInfoKind::IMAGE: isSet = &m_isImageSet[InfoOffsets[i]]; break;
+                case DescriptorInfoKind::BUFFER: isSet = &m_isBufferSet[InfoOffsets[i]]; break;
+                case DescriptorInfoKind::TEXEL_BUFFER: isSet = &m_isTexelBufferSet[InfoOffsets[i]]; break;
+                case DescriptorInfoKind::NONE: continue;
+            }
+            for (uint32_t first = 0; first < desc.count;) {
+                if (!isSet[first]) { first++; continue; }
+                uint32_t end = first + 1;
+                while (end < desc.count && isSet[end]) end++;
+                VkWriteDescriptorSet write {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = m_sets[frameIndex % FRAME_COUNT],
+                        .dstBinding = desc.binding,
+                        .dstArrayElement = first,
+                        .descriptorCount = end - first,
+                        .descriptorType = desc.type,
+                };
+                switch (GetDescriptorInfoKind(desc.type)) {
+                    case DescriptorInfoKind::IMAGE: write.pImageInfo = &m_imageInfos[InfoOffsets[i] + first]; break;
+                    case DescriptorInfoKind::BUFFER: write.pBufferInfo = &m_bufferInfos[InfoOffsets[i] + first]; break;
+                    case DescriptorInfoKind::TEXEL_BUFFER: write.pTexelBufferView = &m_texelBufferViews[InfoOffsets[i] + first]; break;
+                    case DescriptorInfoKind::NONE: break;
+                }
+                batch.Add(write);
+                writeCount++;
+                first = end;
+            }
+        }
+        dirty = 0;
+        return writeCount;
+    }
+    /** CollectWrites and Submit for this set alone, prefer one batch for every set of the frame */
+    uint32_t Flush(VkDevice device, uint32_t frameIndex) {
+        if (!GetDirtyMask(frameIndex)) return 0;
+        DescriptorWriteBatch batch;
+        CollectWrites(frameIndex, batch);
+        return batch.Submit(device);
+    }
+private:
+    void MarkDirty(uint32_t index) {
+        for (DirtyMask& dirty : m_dirty) dirty |= DirtyMask(1) << index;
+    }
+
+    std::array<VkDescriptorSet, FRAME_COUNT> m_sets{};
+    std::array<DirtyMask, FRAME_COUNT> m_dirty{};
+    std::array<VkDescriptorImageInfo, CountInfos(DescriptorInfoKind::IMAGE)> m_imageInfos{};
+    std::array<VkDescriptorBufferInfo, CountInfos(DescriptorInfoKind::BUFFER)> m_bufferInfos{};
+    std::array<VkBufferView, CountInfos(DescriptorInfoKind::TEXEL_BUFFER)> m_texelBufferViews{};
+    // Elements Set at least once, parallel to the infos
+    std::array<bool, CountInfos(DescriptorInfoKind::IMAGE)> m_isImageSet{};
+    std::array<bool, CountInfos(DescriptorInfoKind::BUFFER)> m_isBufferSet{};
+    std::array<bool, CountInfos(DescriptorInfoKind::TEXEL_BUFFER)> m_isTexelBufferSet{};
 };
 
 
@@ -45,10 +646,11 @@ template <int N>
 class Base_DescriptorSet : public Root_DescriptorSet {
 protected:
     VkDevice m_device{};
-    std::array<Descriptor, N> m_descriptors{};
+    const std::array<Descriptor, N>& m_descriptors; // The static Descriptors table of the implementing set
     VkDescriptorSetLayout m_setLayout{};
 public:
-    explicit Base_DescriptorSet(VkDevice device) : m_device(device) {}
+    Base_DescriptorSet(VkDevice device, const std::array<Descriptor, N>& descriptors)
+        : m_device(device), m_descriptors(descriptors) {}
     ~Base_DescriptorSet() override  {
         if (m_setLayout) {
             vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
@@ -57,34 +659,14 @@ public:
     uint32_t GetDescriptorNameCount() final { return N; }
     uint32_t GetTotalDescriptorCount() final { return N; }
     VkDescriptorSetLayout GetDefaultDescriptorSetLayout() final { return m_setLayout; }
-    /** SHOULD BE CALLED BY THE CONSTRUCTOR OF ALL IMPLEMENTING DESCRIPTOR SETS */
-    void MakeDescriptorSetLayout(VkDevice device, VkDescriptorSetLayoutCreateFlags layoutFlags)  {
-        std::array<VkDescriptorSetLayoutBinding, N> setBindings{};
-        for (uint32_t i = 0; i < N; i++) {
-            const Descriptor& desc = m_descriptors[i];
-            setBindings[i] = VkDescriptorSetLayoutBinding{
-                    .binding = i,
-                    .descriptorType = desc.type,
-                    .descriptorCount = desc.count,
-                    .stageFlags = desc.stages,
-                    .pImmutableSamplers = nullptr,
-            };
-        }
-        VkDescriptorSetLayoutCreateInfo createInfo {
-                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-                .flags = 0, // TODO : pending the VK_EXT_descriptor_indexing
-                .bindingCount = N,
-                .pBindings = setBindings.data(),
-
-        };
-        vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &m_setLayout);
+    /** SHOULD BE CALLED BY THE CONSTRUCTOR OF ALL IMPLEMENTING DESCRIPTOR SETS, setBindings must be static storage */
+    void MakeDescriptorSetLayout(VkDevice device, VkDescriptorSetLayoutCreateFlags layoutFlags,
+                                 const std::array<VkDescriptorSetLayoutBinding, N>& setBindings,
+                                 const std::array<VkDescriptorBindingFlags, N>& bindingFlags)  {
+        m_setLayout = CreateDescriptorSetLayout(device, layoutFlags, setBindings, bindingFlags);
     }
     uint32_t GetCountOfDescriptorsWithType(VkDescriptorType descriptorType) final {
-        uint32_t count = 0;
-        for (const Descriptor& desc : m_descriptors)
-            if (desc.type == descriptorType)
-                count += desc.count;
-        return count;
+        return CountDescriptorsWithType(m_descriptors, descriptorType);
     }
 };
 
@@ -100,7 +682,7 @@ public:
 
     explicit TypedDescriptorSetManager(VkDevice device) {
         int index = 0;
-        (..., (DescriptorSets[index++] = reinterpret_cast<Root_DescriptorSet*>(new T(device))));
+        (..., (DescriptorSets[index++] = static_cast<Root_DescriptorSet*>(new T(device))));
     }
     ~TypedDescriptorSetManager() {
         for (Root_DescriptorSet* descSet : DescriptorSets) {
@@ -111,7 +693,7 @@ public:
     template <typename... DescType>
     std::array<VkDescriptorSetLayout, sizeof...(DescType)> GetDescriptorLayouts() {
         std::array<VkDescriptorSetLayout, sizeof...(DescType)> selectedSets = {
-                DescriptorSets[type_index<DescType, T...>::value]->GetCountOfDescriptorsWithType()...
+                DescriptorSets[type_index<DescType, T...>::value]->GetDefaultDescriptorSetLayout()...
         };
         return selectedSets;
     }
@@ -120,8 +702,182 @@ public:
         DescriptorCounts counts{};
         counts.numBuffers = (DescriptorSets[type_index<DescType, T...>::value]->GetCountOfDescriptorsWithType(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) + ...);
         counts.numSamplers = (DescriptorSets[type_index<DescType, T...>::value]->GetCountOfDescriptorsWithType(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) + ...);
+        for (VkDescriptorType type : AllDescriptorTypes)
+            counts.countsByType[DescriptorTypeIndex(type)] = (DescriptorSets[type_index<DescType, T...>::value]->GetCountOfDescriptorsWithType(type) + ...);
+        return counts;
+    }
+
+};
+
+
+/**
+ * Same queries as TypedDescriptorSetManager, resolved at compile time from the static tables of each set type.
+ * The only runtime state of a set is its VkDescriptorSetLayout and update template, those are kept inline, indexed by
+ * type_index. No set objects are created: no heap allocation and no virtual calls.
+ * Pass a DescriptorSetLayoutCache shared by every manager to create each distinct layout once, without one the manager
+ * creates and destroys its own layouts.
+ */
+template<typename... T>
+class StaticDescriptorSetManager {
+    static_assert(AllDerivedFromRoot<T...>, "All types must inherit from Base_DescriptorSet");
+    VkDevice m_device{};
+    std::array<VkDescriptorSetLayout, sizeof...(T)> m_setLayouts{};
+    std::array<VkDescriptorUpdateTemplate, sizeof...(T)> m_updateTemplates{};
+    bool m_ownsLayouts = false; // No shared cache was given, m_setLayouts are destroyed with the manager
+public:
+    /** @param sharedLayouts must outlive the manager, nullptr to keep the layouts to this manager */
+    explicit StaticDescriptorSetManager(VkDevice device, DescriptorSetLayoutCache* sharedLayouts = nullptr)
+        : m_device(device), m_ownsLayouts(sharedLayouts == nullptr) {
+        if (sharedLayouts) m_setLayouts = { sharedLayouts->Get<T>()... };
+        else m_setLayouts = { CreateDescriptorSetLayout(device, T::LayoutFlags, T::LayoutBindings, T::BindingFlags)... };
+        m_updateTemplates = { CreateDescriptorUpdateTemplate(device, GetDescriptorLayout<T>(), T::TemplateEntries)... };
+    }
+    ~StaticDescriptorSetManager() {
+        for (VkDescriptorUpdateTemplate updateTemplate : m_updateTemplates) {
+            if (updateTemplate) vkDestroyDescriptorUpdateTemplate(m_device, updateTemplate, nullptr);
+        }
+        for (VkDescriptorSetLayout setLayout : m_setLayouts) {
+            if (m_ownsLayouts && setLayout) vkDestroyDescriptorSetLayout(m_device, setLayout, nullptr);
+        }
+    }
+    StaticDescriptorSetManager(const StaticDescriptorSetManager&) = delete;
+    StaticDescriptorSetManager& operator=(const StaticDescriptorSetManager&) = delete;
+
+    template <typename DescType>
+    VkDescriptorSetLayout GetDescriptorLayout() const {
+        return m_setLayouts[type_index<DescType, T...>::value];
+    }
+    template <typename... DescType>
+    std::array<VkDescriptorSetLayout, sizeof...(DescType)> GetDescriptorLayouts() const {
+        return { m_setLayouts[type_index<DescType, T...>::value]... };
+    }
+    template <typename DescType>
+    VkDescriptorUpdateTemplate GetUpdateTemplate() const {
+        return m_updateTemplates[type_index<DescType, T...>::value];
+    }
+    /** Every descriptor of set, a DescType allocated with GetDescriptorLayout, in a single vkUpdateDescriptorSetWithTemplate */
+    template <typename DescType>
+    void Write(VkDescriptorSet set, const typename DescType::Payload& payload) const {
+        WriteDescriptorSet<DescType>(m_device, set, GetUpdateTemplate<DescType>(), payload);
+    }
+    template <typename... DescType>
+    static constexpr DescriptorCounts GetDescriptorCounts() {
+        DescriptorCounts counts{};
+        counts.numBuffers = (DescType::template CountOfType<VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER> + ...);
+        counts.numSamplers = (DescType::template CountOfType<VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER> + ...);
+        counts.countsByType = DescriptorPoolSizes<1, DescType...>::Totals;
         return counts;
     }
+    /* DescriptorPoolSizes for MAX_SETS_PER_FRAME of every managed set, see CreateDescriptorPool */
+    template <uint32_t MAX_SETS_PER_FRAME>
+    using PoolSizes = DescriptorPoolSizes<MAX_SETS_PER_FRAME, T...>;
+};
+
+
+/* Layout of the set numbers below a pipeline's highest set that none of its stages use, it has no bindings */
+struct EmptyDescriptorSet {
+    static constexpr VkDescriptorSetLayoutCreateFlags LayoutFlags = 0;
+    static constexpr std::array<VkDescriptorSetLayoutBinding, 0> LayoutBindings{};
+    static constexpr std::array<VkDescriptorBindingFlags, 0> BindingFlags{};
+};
+
+template <typename T, size_t... N>
+constexpr std::array<T, (N + ... + 0)> ConcatArrays(const std::array<T, N>&... arrays) {
+    std::array<T, (N + ... + 0)> result{};
+    size_t offset = 0;
+    ((std::copy(arrays.begin(), arrays.end(), result.begin() + offset), offset += N), ...);
+    return result;
+}
 
+struct PipelineStage {
+    VkShaderStageFlagBits stage;
+    const char* filename; // Relative to SHADER_DIR, or to the patched shader dir if isPatched
+    bool isPatched;       // Renumbered by --compact-bindings, the original file no longer matches the layouts
 };
 
+/**
+ * What a generated pipeline descriptor (a <name>_Pipeline of PipelineData.h) tells the engine about a pipeline it
+ * doesn't know the type of. hash changes whenever the layout, vertex input or any stage's code changes, so it can key
+ * the engine's own pipeline map and tell which entries of a saved VkPipelineCache are stale.
+ */
+struct PipelineManifestEntry {
+    const char* name;
+    uint64_t hash;
+    VkPipelineBindPoint bindPoint;
+    const PipelineStage* stages;
+    uint32_t stageCount;
+};
+
+template <typename... PIPELINE>
+constexpr std::array<PipelineManifestEntry, sizeof...(PIPELINE)> MakePipelineManifest() {
+    return { PipelineManifestEntry{ PIPELINE::Name, PIPELINE::Hash, PIPELINE::BindPoint, PIPELINE::Stages.data(),
+                                    static_cast<uint32_t>(PIPELINE::Stages.size()) }... };
+}
+
+/* Index of the entry with hash, N if there is none */
+template <size_t N>
+constexpr size_t FindPipeline(const std::array<PipelineManifestEntry, N>& manifest, uint64_t hash) {
+    for (size_t i = 0; i < N; i++)
+        if (manifest[i].hash == hash) return i;
+    return N;
+}
+
+template <typename SETS, size_t... I>
+std::array<VkDescriptorSetLayout, sizeof...(I)> GetSetLayouts(DescriptorSetLayoutCache& layouts, std::index_sequence<I...>) {
+    return { layouts.Get<std::tuple_element_t<I, SETS>>()... };
+}
+
+/* Sets come from layouts, so pipelines declaring identical sets get identical, compatible pipeline layouts */
+template <typename PIPELINE>
+VkPipelineLayout CreatePipelineLayout(VkDevice device, DescriptorSetLayoutCache& layouts) {
+    constexpr size_t setCount = std::tuple_size_v<typename PIPELINE::SetLayouts>;
+    std::array<VkDescriptorSetLayout, setCount> setLayouts =
+            GetSetLayouts<typename PIPELINE::SetLayouts>(layouts, std::make_index_sequence<setCount>());
+    VkPipelineLayoutCreateInfo createInfo {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = static_cast<uint32_t>(setCount),
+            .pSetLayouts = setLayouts.data(),
+            .pushConstantRangeCount = static_cast<uint32_t>(PIPELINE::PushConstantRanges.size()),
+            .pPushConstantRanges = PIPELINE::PushConstantRanges.data(),
+    };
+    VkPipelineLayout pipelineLayout{};
+    vkCreatePipelineLayout(device, &createInfo, nullptr, &pipelineLayout);
+    return pipelineLayout;
+}
+
+/* Points straight at the static tables of PIPELINE */
+template <typename PIPELINE>
+constexpr VkPipelineVertexInputStateCreateInfo MakeVertexInputState() {
+    return VkPipelineVertexInputStateCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+            .vertexBindingDescriptionCount = static_cast<uint32_t>(PIPELINE::VertexBindings.size()),
+            .pVertexBindingDescriptions = PIPELINE::VertexBindings.data(),
+            .vertexAttributeDescriptionCount = static_cast<uint32_t>(PIPELINE::VertexAttributes.size()),
+            .pVertexAttributeDescriptions = PIPELINE::VertexAttributes.data(),
+    };
+}
+
+/**
+ * Creates every pipeline of manifest at load time on workerCount threads (0 uses all hardware threads), each claiming
+ * the next entry not taken yet. They all go through pipelineCache, which Vulkan synchronizes internally, so pipelines
+ * sharing stages compile once and a cache saved by a previous run skips compilation entirely.
+ * createPipeline(const PipelineManifestEntry&, VkPipelineCache) -> VkPipeline supplies the state the generator doesn't
+ * know (render passes, blending, ...), and is called concurrently.
+ * @return The pipelines in manifest order
+ */
+template <size_t N, typename CREATE_PIPELINE>
+std::array<VkPipeline, N> WarmUpPipelines(const std::array<PipelineManifestEntry, N>& manifest, VkPipelineCache pipelineCache,
+                                          uint32_t workerCount, CREATE_PIPELINE&& createPipeline) {
+    std::array<VkPipeline, N> pipelines{};
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t i = next++; i < N; i = next++) pipelines[i] = createPipeline(manifest[i], pipelineCache);
+    };
+    if (workerCount == 0) workerCount = std::max(1u, std::thread::hardware_concurrency());
+    workerCount = static_cast<uint32_t>(std::min<size_t>(workerCount, std::max<size_t>(N, 1)));
+    std::vector<std::thread> workers;
+    for (uint32_t w = 1; w < workerCount; w++) workers.emplace_back(work);
+    work();
+    for (std::thread& worker : workers) worker.join();
+    return pipelines;
+}
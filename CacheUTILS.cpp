@@ -0,0 +1,161 @@
+//
+// Content hashing and the on-disk cache that lets unchanged runs skip reflection, merging and emission.
+//
+#include <iomanip>
+#include <unordered_set>
+#include "main.h"
+
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed) {
+    // FNV-1a, simple and stable across platforms, which matters more here than raw speed
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t HashString(const std::string &str, uint64_t seed) {
+    // Include the length so ("ab", "c") and ("a", "bc") don't collide when strings are chained
+    uint64_t size = str.size();
+    return HashBytes(str.data(), str.size(), HashBytes(&size, sizeof(size), seed));
+}
+
+uint64_t HashCombine(uint64_t seed, uint64_t value) {
+    return HashBytes(&value, sizeof(value), seed);
+}
+
+bool HashFile(const std::string &path, uint64_t &outHash) {
+    SpirvFileMapping contents(path);
+    if (!contents.IsValid()) return false;
+    outHash = HashBytes(contents.Words(), contents.ByteSize());
+    return true;
+}
+
+uint64_t HashGeneratorConfigs(const std::vector<GlobalDescriptorSet> &globalSetConfigs,
+                              const std::vector<PipelineConfig> &configs, const ShaderGenOptions &options) {
+    // Only the user-facing fields, the "Not for user" ones are outputs of the run
+    uint64_t hash = HashCombine(0xcbf29ce484222325ull, SHADERGEN_CACHE_VERSION);
+    for (const auto& g : globalSetConfigs) {
+        hash = HashString(g.name, hash);
+        hash = HashCombine(hash, g.globalDescSetID);
+        hash = HashCombine(hash, g.dynamicUniforms.size());
+        for (const auto& name : g.dynamicUniforms) hash = HashString(name, hash);
+    }
+    for (const auto& p : configs) {
+        hash = HashCombine(hash, p.globalDescSetID);
+        hash = HashString(p.pipelineName, hash);
+        hash = HashCombine(hash, p.stages.size());
+        for (const auto& stage : p.stages) {
+            hash = HashString(stage.filename, hash);
+            hash = HashCombine(hash, stage.stageType);
+        }
+        hash = HashCombine(hash, p.layoutFlags.size());
+        for (const auto& flag : p.layoutFlags) hash = HashString(flag, hash);
+        hash = HashCombine(hash, p.vertexStreams.size());
+        for (const auto& stream : p.vertexStreams) {
+            hash = HashString(stream.name, hash);
+            hash = HashCombine(hash, stream.inputs.size());
+            for (const auto& input : stream.inputs) hash = HashString(input, hash);
+        }
+        hash = HashCombine(hash, p.dynamicUniforms.size());
+        for (const auto& name : p.dynamicUniforms) hash = HashString(name, hash);
+        hash = HashCombine(hash, p.quantizedInputs.size());
+        for (const auto& [input, quantization] : p.quantizedInputs) {
+            hash = HashString(input, hash);
+            hash = HashCombine(hash, static_cast<uint64_t>(quantization));
+        }
+    }
+    // workerCount, useCache and the paths never change the generated contents
+    hash = HashCombine(hash, static_cast<uint64_t>(options.deadBindings));
+    hash = HashCombine(hash, options.compactBindings);
+    hash = HashString(options.patchedShaderDir, hash);
+    hash = HashCombine(hash, options.bindlessMinArraySize);
+    hash = HashCombine(hash, options.bindlessDescriptorCount);
+    hash = HashCombine(hash, options.framesInFlight);
+    hash = HashCombine(hash, options.drawOrder.size());
+    for (const auto& name : options.drawOrder) hash = HashString(name, hash);
+    return hash;
+}
+
+GenerationCache MakeGenerationCacheInputs(const std::vector<GlobalDescriptorSet> &globalSetConfigs,
+                                          const std::vector<PipelineConfig> &configs, const ShaderGenOptions &options) {
+    GenerationCache cache{};
+    cache.configHash = HashGeneratorConfigs(globalSetConfigs, configs, options);
+
+    std::unordered_set<std::string> seenFiles;
+    for (const auto& p : configs)
+        for (const auto& stage : p.stages)
+            if (seenFiles.insert(stage.filename).second) cache.stageHashes.emplace_back(stage.filename, 0);
+
+    ParallelForEachIndex(cache.stageHashes.size(), options.workerCount, [&cache](size_t i) {
+        auto& [filename, hash] = cache.stageHashes[i];
+        if (!HashFile(SHADER_DIR + filename, hash)) hash = 0; // Never matches a real file, generation will report it
+    });
+    return cache;
+}
+
+void RecordGenerationCacheOutputs(GenerationCache &INOUT_cache, const std::vector<std::string> &outputFilenames) {
+    INOUT_cache.outputHashes.clear();
+    for (const auto& filename : outputFilenames) {
+        uint64_t hash = 0;
+        if (HashFile(std::string(OUT_DIR) + filename, hash))
+            INOUT_cache.outputHashes.emplace_back(filename, hash);
+    }
+}
+
+bool IsGenerationCacheUpToDate(const GenerationCache &current, const GenerationCache &stored) {
+    if (current.version != stored.version || current.configHash != stored.configHash) return false;
+    if (current.stageHashes != stored.stageHashes) {
+        for (const auto& [filename, hash] : current.stageHashes) {
+            auto it = std::find_if(stored.stageHashes.begin(), stored.stageHashes.end(),
+                                   [&filename](const auto& s) { return s.first == filename; });
+            if (it == stored.stageHashes.end() || it->second != hash)
+                std::cout << "Cache: " << filename << " changed" << std::endl;
+        }
+        return false;
+    }
+    // Someone may have deleted or hand-edited an output in between runs
+    if (stored.outputHashes.empty()) return false;
+    for (const auto& [filename, hash] : stored.outputHashes) {
+        uint64_t diskHash = 0;
+        if (!HashFile(std::string(OUT_DIR) + filename, diskHash) || diskHash != hash) return false;
+    }
+    return true;
+}
+
+bool LoadGenerationCache(const std::string &path, GenerationCache &outCache) {
+    std::ifstream inFile(path);
+    if (!inFile.is_open()) return false;
+
+    GenerationCache cache{};
+    std::string tag;
+    if (!(inFile >> tag >> cache.version) || tag != "ShaderGenCache") return false;
+    while (inFile >> tag) {
+        uint64_t hash = 0;
+        std::string filename;
+        if (tag == "config") {
+            if (!(inFile >> std::hex >> cache.configHash >> std::dec)) return false;
+        } else if (tag == "spv" || tag == "out") {
+            // Filenames are last on the line and may contain spaces
+            if (!(inFile >> std::hex >> hash >> std::dec)) return false;
+            std::getline(inFile >> std::ws, filename);
+            (tag == "spv" ? cache.stageHashes : cache.outputHashes).emplace_back(filename, hash);
+        } else return false;
+    }
+    outCache = cache;
+    return true;
+}
+
+void SaveGenerationCache(const std::string &path, const GenerationCache &cache) {
+    std::ostringstream outFile;
+    outFile << "ShaderGenCache " << cache.version << "\n";
+    outFile << "config " << std::hex << cache.configHash << std::dec << "\n";
+    for (const auto& [filename, hash] : cache.stageHashes)
+        outFile << "spv " << std::hex << hash << std::dec << " " << filename << "\n";
+    for (const auto& [filename, hash] : cache.outputHashes)
+        outFile << "out " << std::hex << hash << std::dec << " " << filename << "\n";
+    WriteFileIfChanged(path, outFile.str());
+}
@@ -0,0 +1,163 @@
+//
+// Dense binding renumbering of merged descriptor sets, and the matching SPIR-V rewrite.
+//
+#include <filesystem>
+#include <map>
+#include <set>
+#include "main.h"
+
+namespace {
+    /** A merged set, and the stage files whose declaration of it went into the merge */
+    struct MergedSetSources {
+        const SpvReflectDescriptorSet* mergedSet;
+        std::vector<std::string> filenames;
+    };
+
+    typedef std::vector<std::pair<uint32_t, uint32_t>> NewByOldBinding;
+
+    NewByOldBinding ProposeNumbering(const SpvReflectDescriptorSet* mergedSet, const SpvReflectDescriptorSet* stageSet,
+                                     bool compact) {
+        NewByOldBinding newByOld;
+        for (uint32_t i = 0; i < stageSet->binding_count; ++i) {
+            uint32_t binding = stageSet->bindings[i]->binding;
+            newByOld.emplace_back(binding, binding);
+        }
+        std::sort(newByOld.begin(), newByOld.end());
+        if (!compact) return newByOld;
+
+        // Merged sets are ordered by binding number and have no holes, their index is the dense number
+        std::unordered_map<uint32_t, uint32_t> liveNumbers;
+        for (uint32_t i = 0; i < mergedSet->binding_count; ++i)
+            liveNumbers.emplace(mergedSet->bindings[i]->binding, i);
+        uint32_t nextDeadNumber = mergedSet->binding_count;
+        for (auto& [oldBinding, newBinding] : newByOld) {
+            auto it = liveNumbers.find(oldBinding);
+            newBinding = it != liveNumbers.end() ? it->second : nextDeadNumber++;
+        }
+        return newByOld;
+    }
+
+    bool IsIdentity(const NewByOldBinding& newByOld) {
+        return std::all_of(newByOld.begin(), newByOld.end(), [](const auto& p) { return p.first == p.second; });
+    }
+}
+
+std::vector<ShaderBindingRemap> CompactBindings(const std::vector<PipelineConfig> &pipelines,
+                                                const std::vector<GlobalDescriptorSet> &globalSets,
+                                                const std::vector<std::array<SpvReflectDescriptorSet *, MAX_DESCRIPTOR_SETS>> &mergedSets,
+                                                ReflectionDatabase &INOUT_database) {
+    assert(pipelines.size() == mergedSets.size());
+    auto addSourceFiles = [&INOUT_database](const PipelineConfig& p, uint32_t setID, std::vector<std::string>& filenames) {
+        for (const auto& stage : p.stages) {
+            SpvReflectShaderModule* module = INOUT_database.GetModule(stage.filename);
+            if (INOUT_database.GetDescSet(module, setID) == nullptr) continue;
+            if (std::find(filenames.begin(), filenames.end(), stage.filename) == filenames.end())
+                filenames.push_back(stage.filename);
+        }
+    };
+    std::vector<MergedSetSources> sources;
+    for (const auto& globalSet : globalSets) {
+        MergedSetSources& globalSources = sources.emplace_back(MergedSetSources{ globalSet.descSet, {} });
+        for (const auto& p : pipelines)
+            if (p.globalDescSetID == globalSet.globalDescSetID) addSourceFiles(p, GLOBAL_DESCSET_INDEX, globalSources.filenames);
+    }
+    for (uint32_t p = 0; p < pipelines.size(); ++p) {
+        for (uint32_t i = 0; i < MAX_DESCRIPTOR_SETS; ++i) {
+            if (i == GLOBAL_DESCSET_INDEX || mergedSets[p][i] == nullptr) continue;
+            MergedSetSources& setSources = sources.emplace_back(MergedSetSources{ mergedSets[p][i], {} });
+            addSourceFiles(pipelines[p], i, setSources.filenames);
+        }
+    }
+
+    // Every (file, set) must get one numbering. Sets that disagree on a shared file fall back to their original
+    // numbers, which can make other sets sharing files with them disagree in turn, so repeat until nothing changes.
+    std::vector<bool> compactable(sources.size(), true);
+    std::map<std::pair<std::string, uint32_t>, NewByOldBinding> numberings;
+    std::set<std::pair<std::string, uint32_t>> reportedConflicts;
+    bool anyConflict = true;
+    while (anyConflict) {
+        anyConflict = false;
+        numberings.clear();
+        std::map<std::pair<std::string, uint32_t>, size_t> firstSource;
+        for (size_t s = 0; s < sources.size(); ++s) {
+            uint32_t setID = sources[s].mergedSet->set;
+            for (const auto& filename : sources[s].filenames) {
+                const SpvReflectDescriptorSet* stageSet = INOUT_database.GetDescSet(INOUT_database.GetModule(filename), setID);
+                auto key = std::make_pair(filename, setID);
+                NewByOldBinding proposal = ProposeNumbering(sources[s].mergedSet, stageSet, compactable[s]);
+                auto [it, isNew] = numberings.emplace(key, proposal);
+                if (isNew) {
+                    firstSource.emplace(key, s);
+                    continue;
+                }
+                if (it->second == proposal) continue;
+                if (reportedConflicts.insert(key).second) {
+                    std::cerr << "ERROR: " << filename << " is part of several merged copies of set " << setID
+                              << " that compact differently, keeping their original binding numbers" << std::endl;
+                }
+                compactable[s] = false;
+                compactable[firstSource[key]] = false;
+                anyConflict = true;
+            }
+        }
+    }
+
+    std::vector<ShaderBindingRemap> remaps;
+    for (auto& [key, newByOld] : numberings) {
+        if (IsIdentity(newByOld)) continue;
+        const auto& [filename, setID] = key;
+        INOUT_database.RenumberBindings(INOUT_database.GetDescSet(INOUT_database.GetModule(filename), setID), newByOld);
+        remaps.push_back(ShaderBindingRemap{ filename, setID, std::move(newByOld) });
+    }
+    return remaps;
+}
+
+std::vector<std::string> WritePatchedShaderModules(const std::vector<ShaderBindingRemap> &remaps,
+                                                   const ReflectionDatabase &database, const std::string &outDir,
+                                                   uint32_t workerCount) {
+    std::vector<std::string> filenames;
+    for (const auto& remap : remaps)
+        if (std::find(filenames.begin(), filenames.end(), remap.filename) == filenames.end())
+            filenames.push_back(remap.filename);
+    if (filenames.empty()) return {};
+
+    std::error_code error;
+    std::filesystem::create_directories(outDir, error);
+    if (error) {
+        std::cerr << "ERROR: could not create '" << outDir << "' for the patched shaders: " << error.message() << std::endl;
+        return {};
+    }
+
+    std::vector<std::string> writtenFilenames(filenames.size());
+    ParallelForEachIndex(filenames.size(), workerCount, [&](size_t f) {
+        const std::string& filename = filenames[f];
+        const SpirvFileMapping* code = database.GetCode(filename);
+        assert(code != nullptr);
+        // The database modules don't own their code (NO_COPY), renumbering rewrites it, so patch a private copy
+        SpvReflectShaderModule patched{};
+        SpvReflectResult result = spvReflectCreateShaderModule(code->ByteSize(), code->Words(), &patched);
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+        // Look every binding up by its old number before changing any, a new number may be another binding's old one
+        std::vector<std::pair<const SpvReflectDescriptorBinding*, uint32_t>> changes;
+        for (const auto& remap : remaps) {
+            if (remap.filename != filename) continue;
+            for (const auto& [oldBinding, newBinding] : remap.newByOldBinding) {
+                if (oldBinding == newBinding) continue;
+                const SpvReflectDescriptorBinding* binding = spvReflectGetDescriptorBinding(&patched, oldBinding, remap.setID, &result);
+                assert(result == SPV_REFLECT_RESULT_SUCCESS);
+                changes.emplace_back(binding, newBinding);
+            }
+        }
+        for (const auto& [binding, newBinding] : changes) {
+            result = spvReflectChangeDescriptorBindingNumbers(&patched, binding, newBinding, SPV_REFLECT_SET_NUMBER_DONT_CHANGE);
+            assert(result == SPV_REFLECT_RESULT_SUCCESS);
+        }
+
+        const char* bytes = reinterpret_cast<const char*>(spvReflectGetCode(&patched));
+        WriteFileIfChanged(outDir + filename, std::string(bytes, spvReflectGetCodeSize(&patched)));
+        writtenFilenames[f] = filename;
+        spvReflectDestroyShaderModule(&patched);
+    });
+    return writtenFilenames;
+}
@@ -4,26 +4,98 @@
 #include "main.h"
 
 
+bool EqualsOrBothNull(const char* a, const char* b) {
+    if (a == nullptr || b == nullptr) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+bool Equals(const SpvReflectNumericTraits& a, const SpvReflectNumericTraits& b) {
+    return a.scalar.width == b.scalar.width && a.scalar.signedness == b.scalar.signedness
+           && a.vector.component_count == b.vector.component_count
+           && a.matrix.column_count == b.matrix.column_count && a.matrix.row_count == b.matrix.row_count
+           && a.matrix.stride == b.matrix.stride;
+}
+
+bool Equals(const SpvReflectArrayTraits& a, const SpvReflectArrayTraits& b) {
+    if (a.dims_count != b.dims_count || a.stride != b.stride) return false;
+    return std::equal(a.dims, a.dims + a.dims_count, b.dims);
+}
+
 bool Equals(SpvReflectTypeDescription *a, SpvReflectTypeDescription *b) {
+    if (a == nullptr || b == nullptr) return a == b;
     if (a->type_flags != b->type_flags) return false;
-    if (strcmp(a->type_name, b->type_name) != 0) return false; // TODO: we only compare the struct name here, so this isn't perfect
+    if (!EqualsOrBothNull(a->type_name, b->type_name)) return false;
+    if (!EqualsOrBothNull(a->struct_member_name, b->struct_member_name)) return false;
+    if (!Equals(a->traits.numeric, b->traits.numeric) || !Equals(a->traits.array, b->traits.array)) return false;
     if (a->member_count != b->member_count) return false;
+    for (uint32_t m = 0; m < a->member_count; ++m) {
+        if (!Equals(&a->members[m], &b->members[m])) return false;
+    }
+    return true;
+}
+
+bool Equals(const SpvReflectBlockVariable &a, const SpvReflectBlockVariable &b) {
+    // The block's own offset and padding depend on where it sits in its parent, so only members' are compared
+    if (a.size != b.size || a.decoration_flags != b.decoration_flags) return false;
+    // Numeric traits alone don't tell a float from a uint
+    uint32_t aTypeFlags = a.type_description ? a.type_description->type_flags : 0;
+    uint32_t bTypeFlags = b.type_description ? b.type_description->type_flags : 0;
+    if (aTypeFlags != bTypeFlags) return false;
+    if (!Equals(a.numeric, b.numeric) || !Equals(a.array, b.array)) return false;
+    return EqualsStructLayout(a, b);
+}
+
+bool EqualsStructLayout(const SpvReflectBlockVariable &a, const SpvReflectBlockVariable &b) {
+    if (a.member_count != b.member_count) return false;
+    for (uint32_t m = 0; m < a.member_count; ++m) {
+        if (!EqualsOrBothNull(a.members[m].name, b.members[m].name)) return false;
+        if (a.members[m].offset != b.members[m].offset) return false;
+        if (!Equals(a.members[m], b.members[m])) return false;
+    }
     return true;
 }
 
+uint64_t HashBlockLayout(const SpvReflectBlockVariable &block) {
+    uint64_t hash = HashCombine(0xcbf29ce484222325ull, block.size);
+    hash = HashCombine(hash, block.decoration_flags);
+    hash = HashCombine(hash, block.type_description ? block.type_description->type_flags : 0);
+    hash = HashBytes(&block.numeric, sizeof(block.numeric), hash);
+    hash = HashCombine(hash, block.array.dims_count);
+    hash = HashBytes(block.array.dims, sizeof(uint32_t) * block.array.dims_count, hash);
+    hash = HashCombine(hash, block.array.stride);
+    return HashCombine(hash, HashStructLayout(block));
+}
+
+uint64_t HashStructLayout(const SpvReflectBlockVariable &block) {
+    uint64_t hash = HashCombine(0xcbf29ce484222325ull, block.member_count);
+    for (uint32_t m = 0; m < block.member_count; ++m) {
+        hash = HashString(block.members[m].name ? block.members[m].name : "", hash);
+        hash = HashCombine(hash, block.members[m].offset);
+        hash = HashCombine(hash, HashBlockLayout(block.members[m]));
+    }
+    return hash;
+}
+
 bool Equals(SpvReflectImageTraits &a, SpvReflectImageTraits &b) {
     return a.image_format == b.image_format
            && a.sampled == b.sampled
            && a.ms == b.ms;
 }
 
+bool IsBufferBlock(SpvReflectDescriptorType descriptorType) {
+    return descriptorType == SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+           descriptorType == SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+           descriptorType == SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+           descriptorType == SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
 bool Equals(SpvReflectDescriptorBinding *a, SpvReflectDescriptorBinding *b) {
     if (a->count != b->count) return false;
     if (a->binding != b->binding) return false;
     if (a->resource_type != b->resource_type) return false;
     if (a->descriptor_type != b->descriptor_type) return false;
-    if (a->descriptor_type == SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
-        return Equals(a->type_description, b->type_description);
+    if (IsBufferBlock(a->descriptor_type)) {
+        return Equals(a->type_description, b->type_description) && Equals(a->block, b->block);
     } else return Equals(a->image, b->image);
 }
 
@@ -36,58 +108,399 @@ bool Equals(SpvReflectDescriptorSet *a, SpvReflectDescriptorSet *b) {
 }
 
 bool CouldBeUnioned(SpvReflectDescriptorSet *a, SpvReflectDescriptorSet *b) {
-    auto unionedSet = Union(a, b);
-    if (unionedSet == nullptr) return false;
-    delete[] unionedSet->bindings;
-    delete unionedSet;
+    DescriptorSetUnion unionSet(a->set);
+    return unionSet.Add(a) && unionSet.IsCompatible(b);
+}
+
+
+SpvReflectDescriptorSet *Union(SpvReflectDescriptorSet *a, SpvReflectDescriptorSet *b, DescriptorSetArena& arena) {
+    DescriptorSetUnion unionSet(a->set);
+    if (!unionSet.Add(a, arena) || !unionSet.Add(b, arena))
+        return nullptr; // Cannot union if the bindings are off
+    return unionSet.Build(arena);
+}
+
+uint32_t CountMaxBinding(SpvReflectDescriptorSet *a) {
+    uint32_t maxBinding = 0;
+    for (uint32_t i = 0; i < a->binding_count; ++i) {
+        if (a->bindings[i]) maxBinding = std::max(maxBinding, a->bindings[i]->binding);
+    }
+    return maxBinding;
+}
+
+
+SpvReflectDescriptorSet *EliminateDeadBindings(SpvReflectDescriptorSet *set, DeadBindingMode mode,
+                                               DescriptorSetArena &arena, DeadBindingReport &INOUT_report) {
+    const uint32_t* accessedStageMasks = arena.GetAccessedStageMasks(set);
+    if (mode == DeadBindingMode::KEEP || accessedStageMasks == nullptr) return set;
+
+    uint32_t liveCount = 0;
+    for (uint32_t i = 0; i < set->binding_count; ++i) {
+        if (accessedStageMasks[i] != 0) {
+            liveCount++;
+            continue;
+        }
+        const SpvReflectDescriptorBinding* binding = set->bindings[i];
+        INOUT_report.bindings++;
+        INOUT_report.descriptors += binding->count;
+        if (IsBufferBlock(binding->descriptor_type)) {
+            INOUT_report.bufferBytes += static_cast<uint64_t>(binding->block.padded_size) * binding->count;
+        }
+        std::cout << "Dead binding " << binding->name << " (set " << set->set << ", binding " << binding->binding << ") "
+                  << (mode == DeadBindingMode::DROP ? "dropped" : "flagged partially bound") << std::endl;
+    }
+    if (liveCount == set->binding_count) return set;
+
+    if (mode == DeadBindingMode::PARTIALLY_BOUND) {
+        uint32_t* bindingFlags = arena.GetBindingFlags(set);
+        for (uint32_t i = 0; i < set->binding_count; ++i)
+            if (accessedStageMasks[i] == 0) bindingFlags[i] |= BINDING_FLAG_PARTIALLY_BOUND;
+        return set;
+    }
+
+    SpvReflectDescriptorSet* liveSet = arena.MakeSet(set->set, liveCount);
+    const uint32_t* stageMasks = arena.GetStageMasks(set);
+    const uint32_t* bindingFlags = arena.GetBindingFlags(set);
+    uint32_t* liveStageMasks = arena.GetStageMasks(liveSet);
+    uint32_t* liveAccessedStageMasks = arena.GetAccessedStageMasks(liveSet);
+    uint32_t* liveBindingFlags = arena.GetBindingFlags(liveSet);
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < set->binding_count; ++i) {
+        if (accessedStageMasks[i] == 0) continue;
+        liveSet->bindings[next] = set->bindings[i];
+        liveStageMasks[next] = stageMasks[i];
+        liveAccessedStageMasks[next] = accessedStageMasks[i];
+        liveBindingFlags[next++] = bindingFlags[i];
+    }
+    return liveSet;
+}
+
+uint32_t MakeBindlessBindings(SpvReflectDescriptorSet *set, uint32_t minArraySize, uint32_t descriptorCount,
+                              DescriptorSetArena &arena) {
+    uint32_t* bindingFlags = arena.GetBindingFlags(set);
+    if (minArraySize == 0 || bindingFlags == nullptr) return 0;
+    uint32_t madeBindless = 0;
+    for (uint32_t i = 0; i < set->binding_count; ++i) {
+        const SpvReflectDescriptorBinding* binding = set->bindings[i];
+        // Dynamic buffers can't be updated after bind, and few devices allow that for uniform buffers or attachments
+        switch (binding->descriptor_type) {
+            case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLER:
+            case SPV_REFLECT_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+            case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+            case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+            case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+            case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+            case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+                break;
+            default:
+                continue;
+        }
+        // Runtime (unsized) arrays are reflected with a count of 0
+        bool isRuntimeArray = binding->count == 0;
+        if (!isRuntimeArray && (binding->array.dims_count == 0 || binding->count < minArraySize)) continue;
+
+        // The shader only indexes what it declares, a sized array keeps its count, the slots past it would be unreachable
+        if (isRuntimeArray) {
+            // Stage modules and other sets may share the binding, only this set's copy gets a count
+            SpvReflectDescriptorBinding* bindlessBinding = arena.CopyBinding(binding);
+            bindlessBinding->count = descriptorCount;
+            set->bindings[i] = bindlessBinding;
+            binding = bindlessBinding;
+        } else if (binding->count < descriptorCount) {
+            std::cerr << "ERROR: bindless array " << binding->name << " (set " << set->set << ", binding " << binding->binding
+                      << ") is declared with " << binding->count << " descriptors, redeclare it unsized to get "
+                      << descriptorCount << std::endl;
+        }
+        bindingFlags[i] |= BINDING_FLAG_PARTIALLY_BOUND | BINDING_FLAG_UPDATE_AFTER_BIND;
+        // Vulkan only allows a variable count on the highest binding of a set, merged sets are ordered by binding
+        if (i + 1 == set->binding_count) bindingFlags[i] |= BINDING_FLAG_VARIABLE_DESCRIPTOR_COUNT;
+        madeBindless++;
+        std::cout << "Bindless binding " << binding->name << " (set " << set->set << ", binding " << binding->binding
+                  << ") with up to " << binding->count << " descriptors" << std::endl;
+    }
+    return madeBindless;
+}
+
+uint32_t MakeDynamicUniforms(SpvReflectDescriptorSet *set, std::unordered_set<std::string> &INOUT_unmatched,
+                             DescriptorSetArena &arena) {
+    if (INOUT_unmatched.empty() || arena.GetBindingFlags(set) == nullptr) return 0;
+    uint32_t madeDynamic = 0;
+    uint32_t dynamicDescriptors = 0;
+    for (uint32_t i = 0; i < set->binding_count; ++i) {
+        const SpvReflectDescriptorBinding* binding = set->bindings[i];
+        if (binding->descriptor_type == SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) dynamicDescriptors += binding->count;
+        if (binding->descriptor_type != SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER) continue;
+        const char* typeName = binding->type_description ? binding->type_description->type_name : nullptr;
+        bool byName = binding->name && INOUT_unmatched.erase(binding->name) > 0;
+        bool byTypeName = typeName && INOUT_unmatched.erase(typeName) > 0;
+        if (!byName && !byTypeName) continue;
+
+        // Stage modules and other sets may share the binding, only this set's copy changes type
+        SpvReflectDescriptorBinding* dynamicBinding = arena.CopyBinding(binding);
+        dynamicBinding->descriptor_type = SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        set->bindings[i] = dynamicBinding;
+        dynamicDescriptors += binding->count;
+        madeDynamic++;
+    }
+    // maxDescriptorSetUniformBuffersDynamic is only guaranteed to be 8, for the whole pipeline layout
+    if (madeDynamic > 0 && dynamicDescriptors > 8) {
+        std::cerr << "WARNING: set " << set->set << " has " << dynamicDescriptors << " dynamic uniform buffers, more than the "
+                  << "8 every device supports" << std::endl;
+    }
+    return madeDynamic;
+}
+
+
+void DescriptorSetUnion::Reset(uint32_t setID) {
+    // Only the occupied slots are ever read, so only the binding array needs clearing, and only up to the last one
+    if (m_bindings.size() < MAX_SET_BINDINGS) {
+        m_bindings.resize(MAX_SET_BINDINGS);
+        m_stageMasks.resize(MAX_SET_BINDINGS);
+        m_accessedStageMasks.resize(MAX_SET_BINDINGS);
+    }
+    std::fill_n(m_bindings.begin(), m_endBinding, nullptr);
+    m_setID = setID;
+    m_endBinding = 0;
+    m_bindingCount = 0;
+}
+
+bool DescriptorSetUnion::IsCompatible(const SpvReflectDescriptorSet *other) const {
+    if (other->set != m_setID) return false;
+    for (uint32_t i = 0; i < other->binding_count; ++i) {
+        SpvReflectDescriptorBinding* binding = other->bindings[i];
+        if (binding == nullptr) continue;
+        if (binding->binding >= m_endBinding) continue;
+        if (m_bindings[binding->binding] && !Equals(m_bindings[binding->binding], binding)) return false;
+    }
     return true;
 }
 
+bool DescriptorSetUnion::Add(const SpvReflectDescriptorSet *other, uint32_t stageMask) {
+    return Merge(other, stageMask, nullptr, nullptr);
+}
+
+bool DescriptorSetUnion::Add(const SpvReflectDescriptorSet *other, const DescriptorSetArena &arena) {
+    return Merge(other, 0, arena.GetStageMasks(other), arena.GetAccessedStageMasks(other));
+}
 
-SpvReflectDescriptorSet *Union(SpvReflectDescriptorSet *a, SpvReflectDescriptorSet *b) {
-    if (a->set != b->set) return nullptr;
-    std::vector<SpvReflectDescriptorBinding*> aBindings(a->bindings, a->bindings + a->binding_count);
-    std::vector<SpvReflectDescriptorBinding*> bBindings(b->bindings, b->bindings + b->binding_count);
+bool DescriptorSetUnion::Merge(const SpvReflectDescriptorSet *other, uint32_t stageMask, const uint32_t *stageMasks,
+                               const uint32_t *accessedStageMasks) {
+    if (!IsCompatible(other)) return false;
+    for (uint32_t i = 0; i < other->binding_count; ++i) {
+        SpvReflectDescriptorBinding* binding = other->bindings[i];
+        if (binding == nullptr) continue;
+        if (binding->binding >= m_bindings.size()) {
+            m_bindings.resize(binding->binding + 1);
+            m_stageMasks.resize(binding->binding + 1);
+            m_accessedStageMasks.resize(binding->binding + 1);
+        }
+        if (!m_bindings[binding->binding]) { // First declaration wins, like before
+            m_bindings[binding->binding] = binding;
+            m_bindingCount++;
+            m_stageMasks[binding->binding] = 0;
+            m_accessedStageMasks[binding->binding] = 0;
+            m_endBinding = std::max(m_endBinding, binding->binding + 1);
+        }
+        m_stageMasks[binding->binding] |= stageMask | (stageMasks ? stageMasks[i] : 0);
+        m_accessedStageMasks[binding->binding] |= (binding->accessed ? stageMask : 0)
+                | (accessedStageMasks ? accessedStageMasks[i] : 0);
+    }
+    return true;
+}
 
-    uint32_t aMaxBinding = CountMaxBinding(a);
-    uint32_t bMaxBinding = CountMaxBinding(b);
-    uint32_t newBindingCount = std::max(aMaxBinding, bMaxBinding) + 1;
-    auto* unionSet = new SpvReflectDescriptorSet{  .set = a->set,  .binding_count = newBindingCount,
-            .bindings = new SpvReflectDescriptorBinding*[newBindingCount], };
+SpvReflectDescriptorSet *DescriptorSetUnion::Build(DescriptorSetArena &arena) const {
+    auto* set = arena.MakeSet(m_setID, m_bindingCount);
+    uint32_t* stageMasks = arena.GetStageMasks(set);
+    uint32_t* accessedStageMasks = arena.GetAccessedStageMasks(set);
+    uint32_t next = 0;
+    for (uint32_t b = 0; b < m_endBinding; ++b) {
+        if (!m_bindings[b]) continue;
+        set->bindings[next] = m_bindings[b];
+        stageMasks[next] = m_stageMasks[b];
+        accessedStageMasks[next++] = m_accessedStageMasks[b];
+    }
+    return set;
+}
 
-    for (uint32_t i = 0; i < newBindingCount; ++i) {
-        auto aBinding = GetBindingOrNull(a, i);
-        auto bBinding = GetBindingOrNull(b, i);
-        if (aBinding && bBinding) {
-            if (!Equals(aBinding, bBinding)) return nullptr; // Cannot union if the bindings are off
-            unionSet->bindings[i] = aBinding;
+SpvReflectDescriptorSet *DescriptorSetArena::MakeSet(uint32_t setID, uint32_t bindingCount) {
+    SpvReflectDescriptorBinding** bindings = nullptr;
+    BindingAnnotations annotations{};
+    if (bindingCount > 0) {
+        if (m_bindingBlocks.empty() || m_blockUsed + bindingCount > m_blockCapacity) {
+            m_blockCapacity = std::max<size_t>(BINDINGS_PER_BLOCK, bindingCount);
+            m_bindingBlocks.emplace_back(std::make_unique<SpvReflectDescriptorBinding*[]>(m_blockCapacity));
+            m_annotationBlocks.emplace_back(std::make_unique<uint32_t[]>(3 * m_blockCapacity)); // Zeroed
+            m_blockUsed = 0;
         }
-        else if (aBinding) unionSet->bindings[i] = aBinding;
-        else if (bBinding) unionSet->bindings[i] = bBinding;
-        else unionSet->bindings[i] = nullptr;
+        bindings = m_bindingBlocks.back().get() + m_blockUsed;
+        uint32_t* annotationBlock = m_annotationBlocks.back().get();
+        annotations.stageMasks = annotationBlock + m_blockUsed;
+        annotations.accessedStageMasks = annotationBlock + m_blockCapacity + m_blockUsed;
+        annotations.bindingFlags = annotationBlock + 2 * m_blockCapacity + m_blockUsed;
+        m_blockUsed += bindingCount;
     }
-    return unionSet;
+    m_sets.push_back(SpvReflectDescriptorSet{ .set = setID, .binding_count = bindingCount, .bindings = bindings });
+    m_annotationsBySet[&m_sets.back()] = annotations;
+    return &m_sets.back();
 }
 
-uint32_t CountMaxBinding(SpvReflectDescriptorSet *a) {
-    uint32_t maxBinding = 0;
-    for (uint32_t i = 0; i < a->binding_count; ++i) {
-        maxBinding = std::max(maxBinding, a->bindings[i]->binding);
+uint32_t *DescriptorSetArena::GetStageMasks(const SpvReflectDescriptorSet *set) {
+    auto it = m_annotationsBySet.find(set);
+    return it == m_annotationsBySet.end() ? nullptr : it->second.stageMasks;
+}
+
+const uint32_t *DescriptorSetArena::GetStageMasks(const SpvReflectDescriptorSet *set) const {
+    auto it = m_annotationsBySet.find(set);
+    return it == m_annotationsBySet.end() ? nullptr : it->second.stageMasks;
+}
+
+uint32_t *DescriptorSetArena::GetAccessedStageMasks(const SpvReflectDescriptorSet *set) {
+    auto it = m_annotationsBySet.find(set);
+    return it == m_annotationsBySet.end() ? nullptr : it->second.accessedStageMasks;
+}
+
+const uint32_t *DescriptorSetArena::GetAccessedStageMasks(const SpvReflectDescriptorSet *set) const {
+    auto it = m_annotationsBySet.find(set);
+    return it == m_annotationsBySet.end() ? nullptr : it->second.accessedStageMasks;
+}
+
+uint32_t *DescriptorSetArena::GetBindingFlags(const SpvReflectDescriptorSet *set) {
+    auto it = m_annotationsBySet.find(set);
+    return it == m_annotationsBySet.end() ? nullptr : it->second.bindingFlags;
+}
+
+const uint32_t *DescriptorSetArena::GetBindingFlags(const SpvReflectDescriptorSet *set) const {
+    auto it = m_annotationsBySet.find(set);
+    return it == m_annotationsBySet.end() ? nullptr : it->second.bindingFlags;
+}
+
+SpvReflectDescriptorBinding *DescriptorSetArena::CopyBinding(const SpvReflectDescriptorBinding *binding) {
+    return &m_bindingCopies.emplace_back(*binding);
+}
+
+std::vector<uint32_t> DescriptorSetArena::GetStageMaskList(const SpvReflectDescriptorSet *set) const {
+    const uint32_t* stageMasks = GetStageMasks(set);
+    if (stageMasks == nullptr) {
+        const uint32_t allGraphics = SPV_REFLECT_SHADER_STAGE_VERTEX_BIT | SPV_REFLECT_SHADER_STAGE_TESSELLATION_CONTROL_BIT |
+                SPV_REFLECT_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | SPV_REFLECT_SHADER_STAGE_GEOMETRY_BIT |
+                SPV_REFLECT_SHADER_STAGE_FRAGMENT_BIT;
+        return std::vector<uint32_t>(set->binding_count, allGraphics);
     }
-    return maxBinding;
+    return std::vector<uint32_t>(stageMasks, stageMasks + set->binding_count);
 }
 
 
-SpvReflectDescriptorBinding *GetBindingOrNull(SpvReflectDescriptorSet *a, uint32_t binding) {
-    for (uint32_t i = 0; i < a->binding_count; ++i) {
-        if (a->bindings[i]->binding == binding) return a->bindings[i];
+const std::string &StructRegistry::Register(const SpvReflectDescriptorBinding *binding, bool &outIsNew) {
+    return Register(binding->type_description->type_name, binding->block, outIsNew);
+}
+
+const std::string &StructRegistry::Register(const std::string &typeName, const SpvReflectBlockVariable &layout, bool &outIsNew) {
+    outIsNew = false;
+    auto matches = [&typeName, &layout](const RegisteredStruct& known) {
+        return known.typeName == typeName && EqualsStructLayout(known.layout, layout);
+    };
+    // Blocks can be copies that don't outlive the registry, so even a known address is confirmed
+    auto known = m_structByBlock.find(&layout);
+    if (known != m_structByBlock.end() && matches(m_structs[known->second])) return m_structs[known->second].emittedName;
+
+    // Only the struct type itself, the same struct can be held as an array, a single member, or a whole block
+    uint64_t layoutHash = HashStructLayout(layout);
+    uint64_t key = HashString(typeName, layoutHash);
+    // Equal keys are compared in full, a hash collision must not alias two different structs
+    auto [begin, end] = m_structsByKey.equal_range(key);
+    auto it = std::find_if(begin, end, [&](const auto& entry) { return matches(m_structs[entry.second]); });
+    size_t index = it == end ? m_structs.size() : it->second;
+    if (it == end) {
+        std::string emittedName = typeName;
+        if (!m_typeNames.insert(typeName).second) {
+            std::ostringstream ssBuilder;
+            ssBuilder << typeName << "_" << std::hex << (layoutHash & 0xffffffffull);
+            emittedName = ssBuilder.str();
+            while (m_emittedNames.count(emittedName)) emittedName += "_";
+            std::cerr << "ERROR: struct " << typeName << " (" << (layout.name ? layout.name : "?") << ") is declared with a"
+                      << " different layout than an earlier struct of the same name, emitting it as " << emittedName << std::endl;
+        }
+        m_structs.push_back(RegisteredStruct{ typeName, layout, emittedName });
+        m_structsByKey.emplace(key, index);
+        m_emittedNames.insert(emittedName);
+        outIsNew = true;
+    }
+    m_structByBlock[&layout] = index;
+    return m_structs[index].emittedName;
+}
+
+std::string GetSetCompatibilityKey(const SpvReflectDescriptorSet *set, const DescriptorSetArena &arena,
+                                   const std::string &layoutFlags) {
+    std::ostringstream key;
+    std::vector<uint32_t> stageMasks = arena.GetStageMaskList(set);
+    const uint32_t* bindingFlags = arena.GetBindingFlags(set);
+    key << layoutFlags << ";";
+    for (uint32_t i = 0; i < set->binding_count; ++i) {
+        const SpvReflectDescriptorBinding* b = set->bindings[i];
+        key << b->binding << ":" << b->descriptor_type << ":" << b->count << ":" << stageMasks[i] << ":"
+            << (bindingFlags ? bindingFlags[i] : 0u) << ";";
+    }
+    return key.str();
+}
+
+std::string GetSetLayoutKey(const SpvReflectDescriptorSet *set, const DescriptorSetArena &arena,
+                            const StructRegistry &structs, const std::string &layoutFlags) {
+    std::ostringstream key;
+    key << GetSetCompatibilityKey(set, arena, layoutFlags) << "|";
+    for (uint32_t i = 0; i < set->binding_count; ++i) {
+        const SpvReflectDescriptorBinding* b = set->bindings[i];
+        key << b->name;
+        if (b->type_description->type_name) key << ":" << structs.GetName(b);
+        key << ";";
     }
-    return nullptr;
+    return key.str();
+}
+
+std::string StructRegistry::GetName(const SpvReflectDescriptorBinding *binding) const {
+    auto it = m_structByBlock.find(&binding->block);
+    if (it != m_structByBlock.end()) return m_structs[it->second].emittedName;
+    return binding->type_description->type_name ? binding->type_description->type_name : "";
 }
 
-void FreeUnionDescSet(SpvReflectDescriptorSet *a) {
-    if (a) {
-        delete[] a->bindings;
-        delete a;
+bool MergePushConstants(const std::vector<std::pair<uint32_t, const SpvReflectBlockVariable *>> &stageBlocks,
+                        MergedPushConstants &outMerged) {
+    outMerged = MergedPushConstants{};
+    bool isCompatible = true;
+    for (const auto& [stageMask, block] : stageBlocks) {
+        if (block == nullptr || block->member_count == 0) continue;
+        uint32_t stageBegin = UINT32_MAX, stageEnd = 0;
+        for (uint32_t m = 0; m < block->member_count; ++m) {
+            const SpvReflectBlockVariable& member = block->members[m];
+            stageBegin = std::min(stageBegin, member.offset);
+            stageEnd = std::max(stageEnd, member.offset + member.size);
+
+            auto same = std::find_if(outMerged.members.begin(), outMerged.members.end(),
+                                     [&member](const SpvReflectBlockVariable& known) { return known.offset == member.offset; });
+            if (same != outMerged.members.end() && Equals(*same, member)) continue;
+            auto overlapping = std::find_if(outMerged.members.begin(), outMerged.members.end(),
+                    [&member](const SpvReflectBlockVariable& known) {
+                        return known.offset < member.offset + member.size && member.offset < known.offset + known.size;
+                    });
+            if (overlapping != outMerged.members.end()) {
+                std::cerr << "ERROR: push constant " << member.name << " (offset " << member.offset << ") overlaps "
+                          << overlapping->name << " (offset " << overlapping->offset << ") of another stage" << std::endl;
+                isCompatible = false;
+                continue;
+            }
+            outMerged.members.push_back(member);
+        }
+
+        // Ranges are in multiples of 4, a stage using exactly the range of another one shares its entry
+        stageBegin &= ~3u;
+        uint32_t stageSize = ((stageEnd + 3u) & ~3u) - stageBegin;
+        auto range = std::find_if(outMerged.ranges.begin(), outMerged.ranges.end(), [&](const MergedPushConstants::StageRange& r) {
+            return r.offset == stageBegin && r.size == stageSize;
+        });
+        if (range != outMerged.ranges.end()) range->stageMask |= stageMask;
+        else outMerged.ranges.push_back(MergedPushConstants::StageRange{ stageMask, stageBegin, stageSize });
+        outMerged.size = std::max(outMerged.size, stageBegin + stageSize);
     }
+    std::sort(outMerged.members.begin(), outMerged.members.end(),
+              [](const SpvReflectBlockVariable& a, const SpvReflectBlockVariable& b) { return a.offset < b.offset; });
+    return isCompatible;
 }
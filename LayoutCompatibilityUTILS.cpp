@@ -0,0 +1,153 @@
+//
+// Pipeline layout compatibility: which descriptor sets stay bound across pipeline switches, and what would keep more.
+//
+#include <set>
+#include "main.h"
+
+namespace {
+    /** Short names for keys, in order of first appearance, so the report can show which layouts are the same */
+    class KeyNames {
+    public:
+        explicit KeyNames(const char* prefix) : m_prefix(prefix) {}
+        const std::string& Get(const std::string& key) {
+            auto it = m_names.find(key);
+            if (it == m_names.end()) it = m_names.emplace(key, m_prefix + std::to_string(m_names.size())).first;
+            return it->second;
+        }
+    private:
+        std::string m_prefix;
+        std::unordered_map<std::string, std::string> m_names;
+    };
+
+    /** Leading sets with identical layouts, regardless of the push constants */
+    uint32_t CountIdenticalSets(const PipelineLayoutSignature& a, const PipelineLayoutSignature& b) {
+        uint32_t limit = std::min(a.GetSetCount(), b.GetSetCount());
+        uint32_t count = 0;
+        while (count < limit && a.setKeys[count] == b.setKeys[count]) count++;
+        return count;
+    }
+
+    uint32_t CountOrderRebinds(const std::vector<PipelineLayoutSignature>& signatures, const std::vector<uint32_t>& order) {
+        uint32_t rebinds = 0;
+        for (size_t i = 1; i < order.size(); ++i)
+            rebinds += CountRebinds(signatures[order[i - 1]], signatures[order[i]]);
+        return rebinds;
+    }
+}
+
+uint32_t PipelineLayoutSignature::GetSetCount() const {
+    for (uint32_t s = MAX_DESCRIPTOR_SETS; s > 0; --s)
+        if (sets[s - 1]) return s;
+    return 0;
+}
+
+std::string GetPushConstantKey(const MergedPushConstants &merged) {
+    std::vector<MergedPushConstants::StageRange> ranges = merged.ranges;
+    std::sort(ranges.begin(), ranges.end(), [](const auto& a, const auto& b) {
+        return std::tie(a.offset, a.size, a.stageMask) < std::tie(b.offset, b.size, b.stageMask);
+    });
+    std::ostringstream key;
+    for (const auto& range : ranges) key << range.stageMask << ":" << range.offset << ":" << range.size << ";";
+    return key.str();
+}
+
+uint32_t CountCompatibleSets(const PipelineLayoutSignature &from, const PipelineLayoutSignature &to) {
+    // Layouts with different push constant ranges aren't compatible for any set
+    if (from.pushConstantKey != to.pushConstantKey) return 0;
+    return CountIdenticalSets(from, to);
+}
+
+uint32_t CountRebinds(const PipelineLayoutSignature &from, const PipelineLayoutSignature &to) {
+    uint32_t rebinds = 0;
+    for (uint32_t s = CountCompatibleSets(from, to); s < MAX_DESCRIPTOR_SETS; ++s)
+        if (to.sets[s]) rebinds++;
+    return rebinds;
+}
+
+std::string WriteLayoutCompatibilityReport(const std::vector<PipelineLayoutSignature> &signatures,
+                                           const std::vector<uint32_t> &drawOrder, uint32_t &outRebinds,
+                                           uint32_t &outRecommendedRebinds) {
+    std::ostringstream report;
+    KeyNames setNames("L"), pushConstantNames("P");
+    report << "Pipeline layout compatibility of " << signatures.size() << " pipelines, for a draw order of "
+           << drawOrder.size() << " pipelines\n";
+    report << "A pipeline switch keeps sets 0..n-1 bound when both layouts define them identically and have identical"
+           << " push constant ranges.\n";
+    report << "Rebinds below are the sets bound again only because the layout changed.\n\n";
+
+    report << "Layouts (identical set layouts share a name, - is an unused set number):\n";
+    for (const auto& signature : signatures) {
+        report << "\t" << signature.pipelineName << ":";
+        for (uint32_t s = 0; s < MAX_DESCRIPTOR_SETS; ++s)
+            report << " set " << s << " " << (signature.sets[s] ? setNames.Get(signature.setKeys[s]) : "-") << ",";
+        report << " push constants " << (signature.pushConstantKey.empty() ? "none" : pushConstantNames.Get(signature.pushConstantKey)) << "\n";
+    }
+
+    report << "\nSwitches in draw order:\n";
+    for (size_t i = 1; i < drawOrder.size(); ++i) {
+        const auto& from = signatures[drawOrder[i - 1]];
+        const auto& to = signatures[drawOrder[i]];
+        if (drawOrder[i - 1] == drawOrder[i]) continue;
+        report << "\t" << from.pipelineName << " -> " << to.pipelineName << ": keeps " << CountCompatibleSets(from, to)
+               << " sets bound, rebinds " << CountRebinds(from, to) << "\n";
+    }
+    outRebinds = CountOrderRebinds(signatures, drawOrder);
+    report << "Total: " << outRebinds << " rebinds\n";
+
+    // Sorting by the set keys in set order puts the pipelines sharing the longest prefixes next to each other
+    std::vector<uint32_t> recommendedOrder = drawOrder;
+    std::stable_sort(recommendedOrder.begin(), recommendedOrder.end(), [&signatures](uint32_t a, uint32_t b) {
+        const auto& sa = signatures[a];
+        const auto& sb = signatures[b];
+        return std::tie(sa.pushConstantKey, sa.setKeys, a) < std::tie(sb.pushConstantKey, sb.setKeys, b);
+    });
+    outRecommendedRebinds = CountOrderRebinds(signatures, recommendedOrder);
+    report << "\nDraw order sharing the longest set prefixes (" << outRecommendedRebinds << " rebinds):\n\t";
+    for (size_t i = 0; i < recommendedOrder.size(); ++i) {
+        if (i > 0 && recommendedOrder[i] == recommendedOrder[i - 1]) continue;
+        report << (i ? ", " : "") << signatures[recommendedOrder[i]].pipelineName;
+    }
+    report << "\n";
+
+    // Layout changes that would keep more sets bound, for every pair of pipelines drawn one after the other
+    std::vector<std::string> recommendations;
+    std::set<std::pair<uint32_t, uint32_t>> seenPairs;
+    for (size_t i = 1; i < drawOrder.size(); ++i) {
+        uint32_t a = std::min(drawOrder[i - 1], drawOrder[i]);
+        uint32_t b = std::max(drawOrder[i - 1], drawOrder[i]);
+        if (a == b || !seenPairs.emplace(a, b).second) continue;
+        const auto& sa = signatures[a];
+        const auto& sb = signatures[b];
+        uint32_t identical = CountIdenticalSets(sa, sb);
+        std::ostringstream ssBuilder;
+        if (sa.pushConstantKey != sb.pushConstantKey && identical > 0) {
+            ssBuilder << sa.pipelineName << " and " << sb.pipelineName << " share sets 0.." << identical - 1
+                      << " but not their push constant ranges, declaring the same ranges in both keeps " << identical << " sets bound";
+            recommendations.push_back(ssBuilder.str());
+            ssBuilder.str("");
+        }
+        uint32_t limit = std::min(sa.GetSetCount(), sb.GetSetCount());
+        if (identical >= limit) continue;
+        // The first set that differs
+        if (sa.sets[identical] && sb.sets[identical] && CouldBeUnioned(sa.sets[identical], sb.sets[identical])) {
+            ssBuilder << "set " << identical << " of " << sa.pipelineName << " and " << sb.pipelineName
+                      << " can be merged into one layout";
+            if (identical == GLOBAL_DESCSET_INDEX) ssBuilder << " (the same globalDescSetID)";
+            ssBuilder << ", keeping set " << identical << " bound";
+            recommendations.push_back(ssBuilder.str());
+            ssBuilder.str("");
+        }
+        // Identical sets above it are rebound anyway, they would stay bound if numbered below it
+        for (uint32_t s = identical + 1; s < limit; ++s) {
+            if (!sa.sets[s] || sa.setKeys[s] != sb.setKeys[s]) continue;
+            ssBuilder << "set " << s << " of " << sa.pipelineName << " and " << sb.pipelineName << " is identical but comes"
+                      << " after set " << identical << " where they differ, numbering it " << identical << " instead keeps it bound";
+            recommendations.push_back(ssBuilder.str());
+            ssBuilder.str("");
+        }
+    }
+    report << "\nRecommendations:\n";
+    if (recommendations.empty()) report << "\tnone\n";
+    for (const auto& recommendation : recommendations) report << "\t" << recommendation << "\n";
+    return report.str();
+}
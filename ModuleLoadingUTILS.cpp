@@ -0,0 +1,83 @@
+//
+// Loading of SPIR-V files for reflection, mmap'd so SPIRV-Reflect can read them without a copy.
+//
+#include "main.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SHADER_METAGEN_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+SpirvFileMapping::SpirvFileMapping(const std::string &path) {
+#ifdef SHADER_METAGEN_HAS_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return; // Nothing to fall back to either, the file can't be opened
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0 && fileStat.st_size % sizeof(uint32_t) == 0) {
+        size_t size = static_cast<size_t>(fileStat.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            m_mapping = mapping;
+            m_words = static_cast<const uint32_t*>(mapping);
+            m_byteSize = size;
+        }
+    }
+    close(fd); // The mapping holds its own reference to the file
+    if (m_mapping) return;
+#endif
+    // Pipes, special files, odd sizes or platforms without mmap
+    ReadIntoMemory(path);
+}
+
+bool SpirvFileMapping::ReadIntoMemory(const std::string &path) {
+    std::ifstream spv_ifstream(path.c_str(), std::ios::binary);
+    if (!spv_ifstream.is_open()) return false;
+
+    spv_ifstream.seekg(0, std::ios::end);
+    size_t size = static_cast<size_t>(spv_ifstream.tellg());
+    spv_ifstream.seekg(0, std::ios::beg);
+
+    // Read into words directly so the code keeps the alignment SPIRV-Reflect expects
+    m_fallback.resize((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+    spv_ifstream.read(reinterpret_cast<char*>(m_fallback.data()), static_cast<std::streamsize>(size));
+    m_words = m_fallback.data();
+    m_byteSize = size;
+    return true;
+}
+
+SpirvFileMapping::~SpirvFileMapping() {
+    Release();
+}
+
+SpirvFileMapping::SpirvFileMapping(SpirvFileMapping &&other) noexcept {
+    *this = std::move(other);
+}
+
+SpirvFileMapping &SpirvFileMapping::operator=(SpirvFileMapping &&other) noexcept {
+    if (this == &other) return *this;
+    Release();
+    m_mapping = other.m_mapping;
+    m_byteSize = other.m_byteSize;
+    m_fallback = std::move(other.m_fallback);
+    // The fallback vector's buffer survives the move, but point at it explicitly rather than rely on that
+    m_words = m_mapping ? other.m_words : (m_fallback.empty() ? nullptr : m_fallback.data());
+    other.m_mapping = nullptr;
+    other.m_words = nullptr;
+    other.m_byteSize = 0;
+    return *this;
+}
+
+void SpirvFileMapping::Release() {
+#ifdef SHADER_METAGEN_HAS_MMAP
+    if (m_mapping) munmap(m_mapping, m_byteSize);
+#endif
+    m_mapping = nullptr;
+    m_words = nullptr;
+    m_byteSize = 0;
+    m_fallback.clear();
+    m_fallback.shrink_to_fit();
+}
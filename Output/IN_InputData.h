@@ -1,5 +1,8 @@
+#pragma once
 #include <vulkan/vulkan.h>
 #include <array>
+#include <cstddef>
+#include <cstdint>
 
 struct vec2 { union { struct { float x; float y; }; float data[2]; }; };
 struct vec3 { union { struct { float x; float y; float z; }; float data[3]; }; };
@@ -18,3 +21,9 @@ struct mat3x4 { union { float data[3][4]; vec4 rows[3]; }; };
 struct mat4x2 { union { float data[4][2]; vec2 rows[4]; }; };
 struct mat4x3 { union { float data[4][3]; vec3 rows[4]; }; };
 struct mat4x4 { union { float data[4][4]; vec4 rows[4]; }; };
+
+/* std140/std430 strides wider than the contents, i.e. float[] and vec3[] elements or mat3 columns padded to a vec4 */
+template <typename T, size_t STRIDE>
+struct padded_elem { T value; uint8_t _pad[STRIDE - sizeof(T)]; };
+template <size_t VECTORS, size_t COMPONENTS, size_t STRIDE>
+struct padded_mat { float data[VECTORS][STRIDE / sizeof(float)]; };
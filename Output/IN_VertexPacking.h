@@ -0,0 +1,251 @@
+//
+// Created by idemaj on 6/20/24.
+//
+
+#ifndef SHADER_METAGEN_IN_VERTEXPACKING_H
+#define SHADER_METAGEN_IN_VERTEXPACKING_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_PACKING_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define VERTEX_PACKING_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define VERTEX_PACKING_F16C
+#include <immintrin.h>
+#endif
+
+/*
+ * Batch converters from full-precision floats to the quantized vertex formats, count floats in, count components out.
+ * Rounding and clamping follow the Vulkan conversion rules for the matching VkFormat (round to nearest even,
+ * NaN packs as the lowest value), the widest instruction set the translation unit is compiled for is used
+ * and the tail is done one component at a time.
+ */
+
+inline uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+    if (magnitude >= 0x47800000) { // Too large for a half, infinite or NaN
+        return static_cast<uint16_t>(sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00));
+    }
+    if (magnitude < 0x38800000) { // Subnormal half, let the float adder do the rounding
+        float shifted;
+        std::memcpy(&shifted, &magnitude, sizeof(shifted));
+        shifted += 0.5f;
+        std::memcpy(&magnitude, &shifted, sizeof(magnitude));
+        return static_cast<uint16_t>(sign | (magnitude - 0x3f000000));
+    }
+    uint32_t mantissaOdd = (magnitude >> 13) & 1;
+    magnitude += 0xc8000fff + mantissaOdd; // Rebias the exponent, round the dropped mantissa bits to nearest even
+    return static_cast<uint16_t>(sign | (magnitude >> 13));
+}
+
+inline float ClampSnorm(float value) { return value > -1.0f ? (value < 1.0f ? value : 1.0f) : -1.0f; }
+inline float ClampUnorm(float value) { return value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f; }
+
+inline int16_t FloatToSnorm16(float value) { return static_cast<int16_t>(std::lrint(ClampSnorm(value) * 32767.0f)); }
+inline uint16_t FloatToUnorm16(float value) { return static_cast<uint16_t>(std::lrint(ClampUnorm(value) * 65535.0f)); }
+inline int8_t FloatToSnorm8(float value) { return static_cast<int8_t>(std::lrint(ClampSnorm(value) * 127.0f)); }
+inline uint8_t FloatToUnorm8(float value) { return static_cast<uint8_t>(std::lrint(ClampUnorm(value) * 255.0f)); }
+
+inline void PackHalf(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+#if defined(VERTEX_PACKING_F16C) && defined(VERTEX_PACKING_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+#endif
+#if defined(VERTEX_PACKING_F16C)
+    for (; i + 4 <= count; i += 4) {
+        __m128i packed = _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+#endif
+    for (; i < count; ++i) dst[i] = FloatToHalf(src[i]);
+}
+
+inline void PackSnorm16(const float* src, int16_t* dst, size_t count) {
+    size_t i = 0;
+#if defined(VERTEX_PACKING_AVX2)
+    const __m256 lo8 = _mm256_set1_ps(-1.0f), hi8 = _mm256_set1_ps(1.0f), scale8 = _mm256_set1_ps(32767.0f);
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo8), hi8), scale8));
+        __m256i b = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), lo8), hi8), scale8));
+        // The packs work per 128 bit lane, put the 64 bit quarters back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+    }
+#endif
+#if defined(VERTEX_PACKING_SSE2)
+    const __m128 lo4 = _mm_set1_ps(-1.0f), hi4 = _mm_set1_ps(1.0f), scale4 = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo4), hi4), scale4));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo4), hi4), scale4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+    }
+#endif
+    for (; i < count; ++i) dst[i] = FloatToSnorm16(src[i]);
+}
+
+inline void PackUnorm16(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+    // Without packus_epi32 (SSE4.1), bias into the signed range, pack with saturation and flip the sign bit back
+#if defined(VERTEX_PACKING_AVX2)
+    const __m256 lo8 = _mm256_setzero_ps(), hi8 = _mm256_set1_ps(1.0f), scale8 = _mm256_set1_ps(65535.0f);
+    const __m256i bias8 = _mm256_set1_epi32(32768);
+    const __m256i flip8 = _mm256_set1_epi16(static_cast<short>(0x8000));
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo8), hi8), scale8));
+        __m256i b = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), lo8), hi8), scale8));
+        __m256i packed = _mm256_packs_epi32(_mm256_sub_epi32(a, bias8), _mm256_sub_epi32(b, bias8));
+        packed = _mm256_xor_si256(_mm256_permute4x64_epi64(packed, 0xd8), flip8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+    }
+#endif
+#if defined(VERTEX_PACKING_SSE2)
+    const __m128 lo4 = _mm_setzero_ps(), hi4 = _mm_set1_ps(1.0f), scale4 = _mm_set1_ps(65535.0f);
+    const __m128i bias4 = _mm_set1_epi32(32768);
+    const __m128i flip4 = _mm_set1_epi16(static_cast<short>(0x8000));
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo4), hi4), scale4));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo4), hi4), scale4));
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias4), _mm_sub_epi32(b, bias4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(packed, flip4));
+    }
+#endif
+    for (; i < count; ++i) dst[i] = FloatToUnorm16(src[i]);
+}
+
+inline void PackSnorm8(const float* src, int8_t* dst, size_t count) {
+    size_t i = 0;
+#if defined(VERTEX_PACKING_AVX2)
+    const __m256 lo8 = _mm256_set1_ps(-1.0f), hi8 = _mm256_set1_ps(1.0f), scale8 = _mm256_set1_ps(127.0f);
+    const __m256i order8 = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; i + 32 <= count; i += 32) {
+        __m256i q[4];
+        for (int k = 0; k < 4; ++k)
+            q[k] = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8 * k), lo8), hi8), scale8));
+        __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(q[0], q[1]), _mm256_packs_epi32(q[2], q[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permutevar8x32_epi32(packed, order8));
+    }
+#endif
+#if defined(VERTEX_PACKING_SSE2)
+    const __m128 lo4 = _mm_set1_ps(-1.0f), hi4 = _mm_set1_ps(1.0f), scale4 = _mm_set1_ps(127.0f);
+    for (; i + 16 <= count; i += 16) {
+        __m128i q[4];
+        for (int k = 0; k < 4; ++k)
+            q[k] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4 * k), lo4), hi4), scale4));
+        __m128i packed = _mm_packs_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+#endif
+    for (; i < count; ++i) dst[i] = FloatToSnorm8(src[i]);
+}
+
+inline void PackUnorm8(const float* src, uint8_t* dst, size_t count) {
+    size_t i = 0;
+#if defined(VERTEX_PACKING_AVX2)
+    const __m256 lo8 = _mm256_setzero_ps(), hi8 = _mm256_set1_ps(1.0f), scale8 = _mm256_set1_ps(255.0f);
+    const __m256i order8 = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; i + 32 <= count; i += 32) {
+        __m256i q[4];
+        for (int k = 0; k < 4; ++k)
+            q[k] = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8 * k), lo8), hi8), scale8));
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(q[0], q[1]), _mm256_packs_epi32(q[2], q[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permutevar8x32_epi32(packed, order8));
+    }
+#endif
+#if defined(VERTEX_PACKING_SSE2)
+    const __m128 lo4 = _mm_setzero_ps(), hi4 = _mm_set1_ps(1.0f), scale4 = _mm_set1_ps(255.0f);
+    for (; i + 16 <= count; i += 16) {
+        __m128i q[4];
+        for (int k = 0; k < 4; ++k)
+            q[k] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4 * k), lo4), hi4), scale4));
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+#endif
+    for (; i < count; ++i) dst[i] = FloatToUnorm8(src[i]);
+}
+
+/*
+ * Checks a kernel against its one component at a time converter, byte for byte, for every count up to MAX_COUNT, so
+ * every SIMD width is hit with every tail length and with the input shifted across the lanes.
+ */
+template <typename PACKED, size_t MAX_COUNT>
+inline bool VerifyPackKernel(void (*pack)(const float*, PACKED*, size_t), PACKED (*convert)(float), const float (&src)[MAX_COUNT]) {
+    PACKED packed[MAX_COUNT], expected[MAX_COUNT];
+    for (size_t count = 1; count <= MAX_COUNT; ++count) {
+        for (size_t first = 0; first < 3 && first + count <= MAX_COUNT; ++first) {
+            pack(src + first, packed, count);
+            for (size_t i = 0; i < count; ++i) expected[i] = convert(src[first + i]);
+            if (std::memcmp(packed, expected, sizeof(PACKED) * count) != 0) return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Self-check of the hand-ordered SIMD kernels above against the scalar path, for counts 1 to 100 of in range values
+ * mixed with NaN, infinities, out of range, subnormal and half-overflow inputs. The result depends on the instruction
+ * sets the caller is compiled for, call it from a debug build of the translation unit that packs, e.g.
+ * assert(VerifyVertexPacking()).
+ */
+inline bool VerifyVertexPacking() {
+    constexpr size_t MAX_COUNT = 100;
+    const float nan = std::numeric_limits<float>::quiet_NaN(), inf = std::numeric_limits<float>::infinity();
+    const float specials[] = {nan, -nan, inf, -inf, 2.0f, -2.0f, 1e30f, -1e30f, 0.0f, -0.0f, 1.0f, -1.0f, 1e-40f,
+                              0.5f / 32767.0f, 1.5f / 255.0f, 65504.0f, 65520.0f, -1e5f, 6e-8f};
+    constexpr size_t SPECIAL_COUNT = sizeof(specials) / sizeof(specials[0]);
+    float src[MAX_COUNT];
+    uint32_t state = 0x9e3779b9u;
+    for (size_t i = 0; i < MAX_COUNT; ++i) {
+        state = state * 1664525u + 1013904223u;
+        // Every third value is special, the rest spread over [-1.5, 1.5) to cover clamping on both sides
+        src[i] = i % 3 == 0 ? specials[(i / 3) % SPECIAL_COUNT] : static_cast<float>(state >> 8) * (3.0f / 16777216.0f) - 1.5f;
+    }
+    return VerifyPackKernel<uint16_t>(PackHalf, FloatToHalf, src) &&
+           VerifyPackKernel<int16_t>(PackSnorm16, FloatToSnorm16, src) &&
+           VerifyPackKernel<uint16_t>(PackUnorm16, FloatToUnorm16, src) &&
+           VerifyPackKernel<int8_t>(PackSnorm8, FloatToSnorm8, src) &&
+           VerifyPackKernel<uint8_t>(PackUnorm8, FloatToUnorm8, src);
+}
+
+/*
+ * Packs count attributes of SRC_N floats each into the DST_N component member at dstOffset of every element of an
+ * interleaved stream. Chunks are converted with PACK into a small buffer first, so the kernels always see contiguous
+ * input, 3 component attributes are widened to the 4 component formats with a zero.
+ */
+template <typename PACKED, size_t SRC_N, size_t DST_N, void (*PACK)(const float*, PACKED*, size_t)>
+inline void PackAttribute(const float* src, size_t count, uint8_t* dst, size_t dstStride, size_t dstOffset) {
+    constexpr size_t CHUNK = 64;
+    alignas(32) float widened[CHUNK * DST_N];
+    alignas(32) PACKED packed[CHUNK * DST_N];
+    for (size_t first = 0; first < count; first += CHUNK) {
+        size_t n = std::min(CHUNK, count - first);
+        const float* chunk = src + first * SRC_N;
+        if constexpr (SRC_N != DST_N) {
+            for (size_t i = 0; i < n; ++i)
+                for (size_t c = 0; c < DST_N; ++c) widened[i * DST_N + c] = c < SRC_N ? chunk[i * SRC_N + c] : 0.0f;
+            chunk = widened;
+        }
+        PACK(chunk, packed, n * DST_N);
+        for (size_t i = 0; i < n; ++i)
+            std::memcpy(dst + (first + i) * dstStride + dstOffset, packed + i * DST_N, sizeof(PACKED) * DST_N);
+    }
+}
+
+#endif //SHADER_METAGEN_IN_VERTEXPACKING_H
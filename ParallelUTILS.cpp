@@ -0,0 +1,77 @@
+//
+// Work-stealing helpers for the embarrassingly parallel parts of generation (module loading and reflection).
+//
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "main.h"
+
+
+namespace {
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> indices;
+    };
+
+    /** Owners take from the back of their own queue... */
+    bool PopOwn(WorkQueue& queue, size_t& outIndex) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.indices.empty()) return false;
+        outIndex = queue.indices.back();
+        queue.indices.pop_back();
+        return true;
+    }
+
+    /** ...and thieves from the front, so they rarely contend over the same end */
+    bool Steal(WorkQueue& queue, size_t& outIndex) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.indices.empty()) return false;
+        outIndex = queue.indices.front();
+        queue.indices.pop_front();
+        return true;
+    }
+}
+
+uint32_t ResolveWorkerCount(uint32_t requested) {
+    if (requested != 0) return requested;
+    uint32_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads == 0 ? 1 : hardwareThreads;
+}
+
+void ParallelForEachIndex(size_t count, uint32_t workerCount, const std::function<void(size_t)>& task) {
+    size_t numWorkers = std::min<size_t>(ResolveWorkerCount(workerCount), count);
+    if (numWorkers <= 1) {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    // Every worker gets a contiguous slice up front, nothing is enqueued after this so an empty sweep means done
+    std::vector<WorkQueue> queues(numWorkers);
+    for (size_t w = 0; w < numWorkers; ++w) {
+        size_t begin = count * w / numWorkers;
+        size_t end = count * (w + 1) / numWorkers;
+        for (size_t i = begin; i < end; ++i) queues[w].indices.push_back(i);
+    }
+
+    auto workerLoop = [&queues, &task, numWorkers](size_t self) {
+        size_t index;
+        while (true) {
+            if (PopOwn(queues[self], index)) {
+                task(index);
+                continue;
+            }
+            bool stole = false;
+            for (size_t offset = 1; offset < numWorkers && !stole; ++offset) {
+                stole = Steal(queues[(self + offset) % numWorkers], index);
+            }
+            if (!stole) return;
+            task(index);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(numWorkers - 1);
+    for (size_t w = 1; w < numWorkers; ++w) workers.emplace_back(workerLoop, w);
+    workerLoop(0);
+    for (auto& worker : workers) worker.join();
+}
@@ -1,6 +1,7 @@
 //
 // Created by idemaj on 6/20/24.
 //
+#include <filesystem>
 #include "main.h"
 
 
@@ -21,6 +22,61 @@ std::string WriteFromFile(const std::string &inFilename) {
     return ssBuilder.str();
 }
 
+bool WriteFileIfChanged(const std::string &path, const std::string &contents) {
+    {
+        std::ifstream existing(path, std::ios::binary | std::ios::ate);
+        if (existing.is_open() && static_cast<size_t>(existing.tellg()) == contents.size()) {
+            std::string onDisk(contents.size(), '\0');
+            existing.seekg(0, std::ios::beg);
+            existing.read(onDisk.data(), static_cast<std::streamsize>(onDisk.size()));
+            if (onDisk == contents) return false;
+        }
+    }
+
+    // Write next to the target so the rename stays on one filesystem and readers never see a partial file
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream outFile(tempPath, std::ios::binary | std::ios::trunc);
+        if (!outFile.is_open()) {
+            std::cerr << "Failed to open the file." << std::endl;
+            return false;
+        }
+        outFile.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        if (!outFile) {
+            std::cerr << "ERROR: failed writing '" << tempPath << "'" << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "ERROR: could not replace '" << path << "': " << error.message() << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+std::string EscapeDepfilePath(const std::string& path) {
+    std::string escaped;
+    for (char c : path) {
+        if (c == ' ' || c == '#') escaped += '\\';
+        else if (c == '$') escaped += '$';
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::string WriteDepfile(const std::vector<std::pair<std::string, std::vector<std::string>>> &targetsToDeps) {
+    std::ostringstream ssBuilder;
+    for (const auto& [target, deps] : targetsToDeps) {
+        ssBuilder << EscapeDepfilePath(target) << ":";
+        for (const auto& dep : deps) ssBuilder << " \\\n\t" << EscapeDepfilePath(dep);
+        ssBuilder << "\n";
+    }
+    return ssBuilder.str();
+}
+
 std::string WriteDescSetLayoutBoilerplate() {
     return WriteFromFile(std::string(BOILERPLATE_DIR) + "/IN_DescSetLayouts.h");
 }
@@ -49,18 +105,14 @@ void reflectInputVariables(const std::vector<SpvReflectInterfaceVariable *> &inp
     auto initTypeDefs = WriteTypeDescriptionsBoilerplate();
     auto vertInputs = WriteVertexInputs(inputVars, "");
     auto instanceInputs = WriteInstanceInputs(inputVars, "");
-    std::ofstream outFile(std::string(OUT_DIR) + "/EX_InputData.h");
-    if (!outFile.is_open()) {
-        std::cerr << "Failed to open the file." << std::endl;
-    }
-
+    std::ostringstream outFile;
     outFile << "#include <vulkan/vulkan.h>\n";
     outFile << "#include <array>\n\n";
     outFile << initTypeDefs;
     outFile << vertInputs;
     outFile << instanceInputs;
 
-    outFile.close();
+    WriteFileIfChanged(std::string(OUT_DIR) + "/EX_InputData.h", outFile.str());
 }
 
 
@@ -85,15 +137,12 @@ std::string GetTypeAsString(SpvReflectTypeDescription *typeDesc) {
  * @param bindings
  */
 void reflectDescriptorSets(const std::string& pipelineName,
-                           const std::vector<SpvReflectDescriptorSet*>& sets) {
+                           const std::vector<SpvReflectDescriptorSet*>& sets, uint32_t stageMask) {
     std::vector<std::string> DEFAULT_DESC_POSTFIXES = {
             "Global", "Material", "Local",
     };
 
-    std::ofstream outFile(std::string(OUT_DIR) + "/EX_DescSetLayoutData.h");
-    if (!outFile.is_open()) {
-        std::cerr << "Failed to open the file." << std::endl;
-    }
+    std::ostringstream outFile;
 
     outFile << "#include <vulkan/vulkan.h>\n";
     outFile << "#include <array>\n";
@@ -101,28 +150,28 @@ void reflectDescriptorSets(const std::string& pipelineName,
 
     std::vector<std::pair<uint32_t, std::string>> regDescSets;
     std::vector<std::vector<SpvReflectDescriptorBinding*>> bindingsToSet_forDebug;
+    StructRegistry structs;
     outFile << WriteDescSetLayoutBoilerplate() << std::endl;
     for (auto set : sets) {
         std::string setName = pipelineName + DEFAULT_DESC_POSTFIXES[set->set];
         std::vector<SpvReflectDescriptorBinding *> setBindings(set->bindings, set->bindings + set->binding_count);
-        outFile << WriteUsedStructsInDescSet(setBindings) << "\n\n";
-        outFile << WriteDescSetLayout(setBindings, setName) << "\n\n";
+        outFile << WriteUsedStructsInDescSet(setBindings, structs) << "\n\n";
+        outFile << WriteDescSetLayout(setBindings, setName, &structs) << "\n\n";
         regDescSets.emplace_back(set->set, setName);
     }
-    outFile << "\n\n// TODO: functionality for coupling bindings to stages" << std::endl;
-    outFile << WriteDescSetLayoutManager(regDescSets, sets) << std::endl;
+    outFile << "\n\n";
+    outFile << WriteDescSetLayoutManager(regDescSets, sets, stageMask) << std::endl;
+    WriteFileIfChanged(std::string(OUT_DIR) + "/EX_DescSetLayoutData.h", outFile.str());
 }
 
 std::string WriteDescSetLayoutManager(const std::vector<std::pair<uint32_t, std::string>> &regDescSets,
-                                      const std::vector<SpvReflectDescriptorSet *> &sets) {
+                                      const std::vector<SpvReflectDescriptorSet *> &sets, uint32_t stageMask) {
     std::ostringstream ssBuilder;
-    for (const auto& [setID, setName] : regDescSets) {
-        ssBuilder << "typedef " << setName << "_DescriptorSet<";
-        uint32_t numBindings = sets[setID]->binding_count;
-        for (uint32_t i = 0; i < numBindings; ++i) {
-            ssBuilder << "VK_SHADER_STAGE_ALL_GRAPHICS, ";
-        }
-        ssBuilder << "VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT> " << setName << "_IMPL;\n";
+    // All the sets come from a single module, every binding is seen by its stage only
+    for (uint32_t i = 0; i < regDescSets.size(); ++i) {
+        const std::string& setName = regDescSets[i].second;
+        std::vector<uint32_t> bindingStageMasks(sets[i]->binding_count, stageMask);
+        ssBuilder << WriteDescSetTypedef(setName, bindingStageMasks, setName + "_IMPL");
     }
     ssBuilder << "typedef TypedDescriptorSetManager<";
     for (uint32_t i = 0; i < regDescSets.size() - 1; ++i) {
@@ -130,10 +179,103 @@ std::string WriteDescSetLayoutManager(const std::vector<std::pair<uint32_t, std:
     }
     ssBuilder << regDescSets[regDescSets.size() - 1].second << "_IMPL> TestDescriptorSetManager;\n";
     ssBuilder << "typedef TestDescriptorSetManager MainDescriptorSetManager;\n";
+    ssBuilder << "typedef StaticDescriptorSetManager<";
+    for (uint32_t i = 0; i < regDescSets.size(); ++i) {
+        ssBuilder << (i ? ", " : "") << regDescSets[i].second << "_IMPL";
+    }
+    ssBuilder << "> StaticMainDescriptorSetManager;\n";
+    return ssBuilder.str();
+}
+
+std::string WritePushConstants(const MergedPushConstants &merged, const std::string &name, StructRegistry &INOUT_structs) {
+    std::ostringstream ssBuilder;
+    std::string structName = name + "_PushConstants";
+    // The struct spans the whole push constant space up to the last member, stages only ever see their own part of it
+    SpvReflectBlockVariable block{};
+    block.member_count = static_cast<uint32_t>(merged.members.size());
+    block.members = const_cast<SpvReflectBlockVariable*>(merged.members.data());
+    block.size = merged.size;
+    block.padded_size = merged.size;
+    ssBuilder << WriteBlockStruct(block, structName, 0, INOUT_structs) << "\n";
+
+    // vkCmdPushConstants needs every stage whose range includes a byte it updates, so cut the block at every range
+    // boundary and push each piece with exactly the stages that see it
+    std::vector<uint32_t> cuts;
+    for (const auto& range : merged.ranges) {
+        cuts.push_back(range.offset);
+        cuts.push_back(range.offset + range.size);
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+    std::vector<MergedPushConstants::StageRange> segments;
+    for (size_t c = 0; c + 1 < cuts.size(); ++c) {
+        uint32_t stageMask = 0;
+        for (const auto& range : merged.ranges)
+            if (range.offset <= cuts[c] && cuts[c + 1] <= range.offset + range.size) stageMask |= range.stageMask;
+        if (stageMask == 0) continue;
+        if (!segments.empty() && segments.back().stageMask == stageMask && segments.back().offset + segments.back().size == cuts[c])
+            segments.back().size += cuts[c + 1] - cuts[c];
+        else segments.push_back(MergedPushConstants::StageRange{ stageMask, cuts[c], cuts[c + 1] - cuts[c] });
+    }
+
+    auto writeRanges = [&ssBuilder](const char* arrayName, const std::vector<MergedPushConstants::StageRange>& ranges) {
+        ssBuilder << "\tstatic constexpr std::array<VkPushConstantRange, " << ranges.size() << "> " << arrayName << " = {\n";
+        for (const auto& range : ranges) {
+            ssBuilder << "\t\tVkPushConstantRange{ " << GetStageFlagsAsString(range.stageMask) << ", "
+                      << range.offset << ", " << range.size << " },\n";
+        }
+        ssBuilder << "\t};\n";
+    };
+    ssBuilder << "struct " << name << "_PushConstantLayout {\n";
+    ssBuilder << "\t/* For VkPipelineLayoutCreateInfo::pPushConstantRanges, one per distinct stage range */\n";
+    writeRanges("Ranges", merged.ranges);
+    ssBuilder << "\t/* Pieces of the block seen by the same stages, what Push records */\n";
+    writeRanges("PushSegments", segments);
+    ssBuilder << "\tstatic void Push(VkCommandBuffer commandBuffer, VkPipelineLayout layout, const " << structName << "& data) {\n";
+    ssBuilder << "\t\tconst auto* bytes = reinterpret_cast<const uint8_t*>(&data);\n";
+    ssBuilder << "\t\tfor (const VkPushConstantRange& segment : PushSegments)\n";
+    ssBuilder << "\t\t\tvkCmdPushConstants(commandBuffer, layout, segment.stageFlags, segment.offset, segment.size, bytes + segment.offset);\n";
+    ssBuilder << "\t}\n";
+    ssBuilder << "};\n";
+    return ssBuilder.str();
+}
+
+void reflectPushConstants(const std::vector<SpvReflectBlockVariable *> &pushConstants, uint32_t stageMask) {
+    std::ostringstream outFile;
+    outFile << "#include <vulkan/vulkan.h>\n";
+    outFile << "#include <array>\n";
+    outFile << "#include \"InputData.h\"\n\n";
+
+    StructRegistry structs;
+    for (const SpvReflectBlockVariable* block : pushConstants) {
+        MergedPushConstants merged;
+        MergePushConstants({ { stageMask, block } }, merged);
+        std::string name = block->type_description && block->type_description->type_name
+                ? block->type_description->type_name : "TestExample";
+        outFile << WritePushConstants(merged, name, structs) << "\n\n";
+    }
+    WriteFileIfChanged(std::string(OUT_DIR) + "/EX_PushConstantData.h", outFile.str());
+}
+
+std::string WriteDescSetTypedef(const std::string &setName, const std::vector<uint32_t> &bindingStageMasks,
+                                const std::string &typedefName, const std::string &layoutFlags) {
+    std::ostringstream ssBuilder;
+    ssBuilder << "typedef " << setName << "_DescriptorSet<";
+    for (uint32_t stageMask : bindingStageMasks) {
+        ssBuilder << GetStageFlagsAsString(stageMask) << ", ";
+    }
+    ssBuilder << layoutFlags << "> " << typedefName << ";\n";
     return ssBuilder.str();
 }
 
-std::string WriteDescSetLayout(const std::vector<SpvReflectDescriptorBinding *> &bindings, const std::string &setName) {
+std::string WriteFramedDescSetTypedef(const std::string &typedefName, uint32_t framesInFlight) {
+    std::string framedName = typedefName;
+    if (framedName.size() > 5 && framedName.compare(framedName.size() - 5, 5, "_IMPL") == 0) framedName.resize(framedName.size() - 5);
+    return "typedef FramedDescriptorSet<" + typedefName + ", " + std::to_string(framesInFlight) + "> " + framedName + "_Framed;\n";
+}
+
+std::string WriteDescSetLayout(const std::vector<SpvReflectDescriptorBinding *> &bindings, const std::string &setName,
+                               const StructRegistry* structs, const uint32_t* bindingFlags) {
     std::ostringstream ssBuilder;
     const char* stageFlagPostfix = "_STAGES";
     const char* baseSetClassName = "Base_DescriptorSet";
@@ -143,118 +285,482 @@ std::string WriteDescSetLayout(const std::vector<SpvReflectDescriptorBinding *>
     ssBuilder << "VkDescriptorSetLayoutCreateFlags LAYOUT_FLAGS=0>\n";
     ssBuilder << "class " << setName << "_DescriptorSet : public " << baseSetClassName << "<" << bindings.size() << "> {\n";
     ssBuilder << "public:\n";
-    ssBuilder << "\texplicit " << setName << "_DescriptorSet(VkDevice device) : " << baseSetClassName << "(device) {\n";
-    for (auto* b : bindings) {
-        ssBuilder << "\t\tm_descriptors[" << b->binding << "] = Descriptor{ \"" << b->name << "\", "
+    // Everything about the layout is known here, so the tables live in static storage and are built by the compiler
+    ssBuilder << "\tstatic constexpr std::array<Descriptor, " << bindings.size() << "> Descriptors = {\n";
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        auto* b = bindings[i];
+        ssBuilder << "\t\tDescriptor{ \"" << b->name << "\", " << b->binding << ", "
                   << GetDescriptorTypeAsString(b->descriptor_type) << ", " << b->count << ", ";
         if (b->type_description->type_name) // If a buffer struct
-            ssBuilder << "sizeof(" << b->type_description->type_name << "), ";
+            ssBuilder << "sizeof(" << (structs ? structs->GetName(b) : b->type_description->type_name) << "), ";
         else ssBuilder << "0, ";
-        ssBuilder << b->name << stageFlagPostfix << " };\n";
+        ssBuilder << b->name << stageFlagPostfix;
+        if (bindingFlags && bindingFlags[i]) ssBuilder << ", " << GetBindingFlagsAsString(bindingFlags[i]);
+        ssBuilder << " },\n";
+    }
+    ssBuilder << "\t};\n";
+    ssBuilder << "\tstatic constexpr std::array<VkDescriptorSetLayoutBinding, " << bindings.size()
+              << "> LayoutBindings = MakeLayoutBindings(Descriptors);\n";
+    ssBuilder << "\tstatic constexpr std::array<VkDescriptorBindingFlags, " << bindings.size()
+              << "> BindingFlags = MakeBindingFlags(Descriptors);\n";
+    ssBuilder << "\tstatic constexpr VkDescriptorSetLayoutCreateFlags LayoutFlags = LAYOUT_FLAGS;\n";
+    ssBuilder << "\ttemplate <VkDescriptorType TYPE>\n";
+    ssBuilder << "\tstatic constexpr uint32_t CountOfType = CountDescriptorsWithType(Descriptors, TYPE);\n";
+    ssBuilder << "\t/* pDynamicOffsets entries vkCmdBindDescriptorSets needs for this set, in binding order */\n";
+    ssBuilder << "\tstatic constexpr uint32_t DynamicOffsetCount = CountDescriptorsWithType(Descriptors, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)\n";
+    ssBuilder << "\t\t\t+ CountDescriptorsWithType(Descriptors, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC);\n";
+
+    // Update template, one entry per binding pointing at its array in Payload. Bindless arrays are left out, they are
+    // written an element at a time, and so are acceleration structures, which need a pNext chain. So are runtime arrays
+    // that weren't made bindless, they have no descriptors to write (and a zero-length member isn't C++)
+    std::vector<uint32_t> templateBindings;
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        if (bindingFlags && (bindingFlags[i] & BINDING_FLAG_UPDATE_AFTER_BIND)) continue;
+        if (bindings[i]->count == 0) continue;
+        if (GetDescriptorInfoTypeAsString(bindings[i]->descriptor_type).empty()) continue;
+        templateBindings.push_back(i);
+    }
+    ssBuilder << "\t/* Every descriptor of the set, written in one go by WriteDescriptorSet with TemplateEntries */\n";
+    ssBuilder << "\tstruct Payload {\n";
+    for (uint32_t i : templateBindings) {
+        ssBuilder << "\t\t" << GetDescriptorInfoTypeAsString(bindings[i]->descriptor_type) << " " << bindings[i]->name
+                  << "[" << bindings[i]->count << "];\n";
+    }
+    ssBuilder << "\t};\n";
+    ssBuilder << "\tstatic constexpr std::array<VkDescriptorUpdateTemplateEntry, " << templateBindings.size()
+              << "> TemplateEntries = {" << (templateBindings.empty() ? "" : "\n");
+    for (uint32_t i : templateBindings) {
+        auto* b = bindings[i];
+        ssBuilder << "\t\tVkDescriptorUpdateTemplateEntry{ " << b->binding << ", 0, " << b->count << ", "
+                  << GetDescriptorTypeAsString(b->descriptor_type) << ", offsetof(Payload, " << b->name << "), sizeof("
+                  << GetDescriptorInfoTypeAsString(b->descriptor_type) << ") },\n";
+    }
+    ssBuilder << (templateBindings.empty() ? "" : "\t") << "};\n";
+    // Bindless arrays, see MakeBindlessBindings: hand out array elements, write them with WriteBindlessSlot
+    for (uint32_t i = 0; bindingFlags && i < bindings.size(); ++i) {
+        if (!(bindingFlags[i] & BINDING_FLAG_UPDATE_AFTER_BIND)) continue;
+        ssBuilder << "\tusing " << bindings[i]->name << "_SlotAllocator = BindlessSlotAllocator<" << bindings[i]->count << ">;\n";
     }
-    ssBuilder << "\t\tMakeDescriptorSetLayout(device, LAYOUT_FLAGS);\n\t}\n";
+    ssBuilder << "\n";
+
+    ssBuilder << "\texplicit " << setName << "_DescriptorSet(VkDevice device) : " << baseSetClassName << "(device, Descriptors) {\n";
+    ssBuilder << "\t\tMakeDescriptorSetLayout(device, LAYOUT_FLAGS, LayoutBindings, BindingFlags);\n\t}\n";
+    ssBuilder << "\tconst char* GetName() final { return \"" << setName << "\"; }\n";
+    ssBuilder << "\tVkDescriptorSetLayoutCreateFlags GetLayoutFlags() final { return LAYOUT_FLAGS; }\n";
     ssBuilder << "};\n";
 
     return ssBuilder.str();
 }
 
-bool isIn(const std::string& key, const std::vector<std::string> &vals) {
-    return std::find(vals.begin(), vals.end(), key) != vals.end();
-}
 std::string
-WriteUsedStructsInDescSet(const std::vector<SpvReflectDescriptorBinding *> &bindings, const std::vector<std::string> &prohibitedStructs) {
-    // TODO: cannot handle struct types yet, that shouldn't be a terrible change tho
+WriteUsedStructsInDescSet(const std::vector<SpvReflectDescriptorBinding *> &bindings, StructRegistry &INOUT_structs) {
     std::ostringstream ssBuilder;
     for (SpvReflectDescriptorBinding* binding : bindings) {
-        if (binding->descriptor_type != SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER) continue;
-        auto structDesc = binding->type_description;
-        if (isIn(structDesc->type_name, prohibitedStructs)) {
-            std::cout << "Multi-declare filtered for desc struct " << structDesc->type_name << std::endl;
+        if (!IsBufferBlock(binding->descriptor_type)) continue;
+        bool isNew = false;
+        const std::string& structName = INOUT_structs.Register(binding, isNew);
+        if (!isNew) {
+            std::cout << "Multi-declare filtered for desc struct " << structName << std::endl;
             continue;
         }
+        bool isUniform = binding->descriptor_type == SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+                         binding->descriptor_type == SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        // std140: uniform blocks (and their arrays) are aligned to a vec4. std430 storage blocks keep their natural
+        // alignment, so a header ends exactly where its runtime-sized array starts
+        ssBuilder << WriteBlockStruct(binding->block, structName, isUniform ? 16 : 0, INOUT_structs);
+    }
+    return ssBuilder.str();
+}
+
+std::string WriteStructAtOffsets(const SpvReflectBlockVariable &block, const std::string &structName, uint32_t alignment,
+                                 uint32_t targetSize, StructRegistry &INOUT_structs, uint32_t &outSize);
 
-        ssBuilder << "struct " << structDesc->type_name << " {\n";
-        for (size_t m = 0; m < structDesc->member_count; ++m) {
-            auto* member = &structDesc->members[m];
-            ssBuilder << "\t" << GetTypeAsString(member) << " " << member->struct_member_name;
-            if (member->traits.array.dims_count == 1) ssBuilder << "[" << member->traits.array.dims[0] << "]";
-            ssBuilder << ";\n";
+/**
+ * C++ type of a single element of a block member, arrays are left to the caller.
+ * Struct types get written to INOUT_nested the first time they are seen.
+ */
+std::string GetBlockElementTypeAsString(const SpvReflectBlockVariable &member, StructRegistry &INOUT_structs,
+                                        std::ostringstream &INOUT_nested, uint32_t &outSize) {
+    const SpvReflectTypeDescription* typeDesc = member.type_description;
+    if (typeDesc->type_flags & SpvReflectTypeFlagBits::SPV_REFLECT_TYPE_FLAG_STRUCT) {
+        bool isNew = false;
+        std::string nestedName = INOUT_structs.Register(typeDesc->type_name, member, isNew);
+        // Padded only up to its own alignment, whoever holds the struct pads up to the next offset or array stride
+        std::string nested = WriteStructAtOffsets(member, nestedName, 0, 0, INOUT_structs, outSize);
+        if (isNew) INOUT_nested << nested << "\n";
+        return nestedName;
+    }
+
+    uint32_t scalarSize = member.numeric.scalar.width / 8;
+    std::ostringstream ssBuilder;
+    if (typeDesc->type_flags & SpvReflectTypeFlagBits::SPV_REFLECT_TYPE_FLAG_MATRIX) {
+        const auto& matrix = member.numeric.matrix;
+        bool rowMajor = member.decoration_flags & SpvReflectDecorationFlagBits::SPV_REFLECT_DECORATION_ROW_MAJOR;
+        uint32_t vectorCount = rowMajor ? matrix.row_count : matrix.column_count;
+        uint32_t vectorSize = rowMajor ? matrix.column_count : matrix.row_count;
+        outSize = vectorCount * matrix.stride;
+        if (matrix.stride == vectorSize * scalarSize) ssBuilder << "mat" << vectorCount << "x" << vectorSize;
+        else ssBuilder << "padded_mat<" << vectorCount << ", " << vectorSize << ", " << matrix.stride << ">";
+        return ssBuilder.str();
+    }
+
+    uint32_t componentCount = (typeDesc->type_flags & SpvReflectTypeFlagBits::SPV_REFLECT_TYPE_FLAG_VECTOR)
+            ? member.numeric.vector.component_count : 1;
+    outSize = componentCount * scalarSize;
+    if (scalarSize == 4) return GetTypeAsString(const_cast<SpvReflectTypeDescription*>(typeDesc));
+
+    // The vecN/ivecN boilerplate is 32 bit only
+    bool isFloat = typeDesc->type_flags & SpvReflectTypeFlagBits::SPV_REFLECT_TYPE_FLAG_FLOAT;
+    if (isFloat) ssBuilder << (scalarSize == 8 ? "double" : "uint16_t /* half */");
+    else ssBuilder << (member.numeric.scalar.signedness ? "int" : "uint") << scalarSize * 8 << "_t";
+    if (componentCount == 1) return ssBuilder.str();
+    return "std::array<" + ssBuilder.str() + ", " + std::to_string(componentCount) + ">";
+}
+
+/**
+ * Alignment C++ gives the type written for a block member: its widest scalar, since the vector and matrix
+ * boilerplate is made of plain scalar arrays
+ */
+uint32_t GetHostAlignment(const SpvReflectBlockVariable &member) {
+    if (member.member_count == 0) return std::max(member.numeric.scalar.width / 8, 1u);
+    uint32_t alignment = 1;
+    for (uint32_t m = 0; m < member.member_count; ++m) alignment = std::max(alignment, GetHostAlignment(member.members[m]));
+    return alignment;
+}
+
+/**
+ * @param targetSize pads the struct up to this size, 0 to stop right after the last member
+ * @param outSize size of the written struct
+ */
+std::string WriteStructAtOffsets(const SpvReflectBlockVariable &block, const std::string &structName, uint32_t alignment,
+                                 uint32_t targetSize, StructRegistry &INOUT_structs, uint32_t &outSize) {
+    std::ostringstream nestedBuilder, ssBuilder, assertBuilder;
+    uint32_t cursor = 0;
+    uint32_t padCount = 0;
+    bool hasRuntimeArray = false;
+
+    ssBuilder << "struct ";
+    if (alignment > 0) ssBuilder << "alignas(" << alignment << ") ";
+    ssBuilder << structName << " {\n";
+    for (uint32_t m = 0; m < block.member_count; ++m) {
+        const SpvReflectBlockVariable& member = block.members[m];
+        if (member.array.dims_count > 0 && member.array.dims[0] == 0) {
+            // The struct is the fixed header of the buffer, the runtime-sized array follows it, see SizeFor
+            if (member.offset > cursor) ssBuilder << "\tuint8_t _pad" << padCount++ << "[" << member.offset - cursor << "];\n";
+            cursor = member.offset;
+            uint32_t elementSize = 0;
+            std::string elementName = GetBlockElementTypeAsString(member, INOUT_structs, nestedBuilder, elementSize);
+            for (uint32_t d = 1; d < member.array.dims_count; ++d) elementName += "[" + std::to_string(member.array.dims[d]) + "]";
+            uint32_t stride = member.array.stride;
+            if (member.array.dims_count == 1 && stride != elementSize)
+                elementName = "padded_elem<" + elementName + ", " + std::to_string(stride) + ">";
+            std::string elementTypedef = structName + "_" + member.name + "Element";
+            nestedBuilder << "using " << elementTypedef << " = " << elementName << ";\n";
+            nestedBuilder << "static_assert(sizeof(" << elementTypedef << ") == " << stride << ");\n";
+
+            ssBuilder << "\n\t/* " << member.name << "[] is runtime-sized, its elements start right after this header */\n";
+            ssBuilder << "\ttypedef " << elementTypedef << " Element;\n";
+            ssBuilder << "\tstatic constexpr size_t ElementOffset = " << member.offset << ";\n";
+            ssBuilder << "\tstatic constexpr size_t ElementStride = " << stride << ";\n";
+            ssBuilder << "\t/* Bytes of a buffer holding elementCount elements, for the buffer and descriptor range */\n";
+            ssBuilder << "\tstatic constexpr size_t SizeFor(size_t elementCount) { return ElementOffset + elementCount * ElementStride; }\n";
+            ssBuilder << "\t/* Elements that fit in a buffer of byteSize bytes */\n";
+            ssBuilder << "\tstatic constexpr size_t CountFor(size_t byteSize) {\n";
+            ssBuilder << "\t\treturn byteSize < ElementOffset ? 0 : (byteSize - ElementOffset) / ElementStride;\n\t}\n";
+            ssBuilder << "\tstatic Element* " << member.name << "(void* buffer) {\n";
+            ssBuilder << "\t\treturn reinterpret_cast<Element*>(static_cast<uint8_t*>(buffer) + ElementOffset);\n\t}\n";
+            ssBuilder << "\tstatic const Element* " << member.name << "(const void* buffer) {\n";
+            ssBuilder << "\t\treturn reinterpret_cast<const Element*>(static_cast<const uint8_t*>(buffer) + ElementOffset);\n\t}\n";
+            hasRuntimeArray = true;
+            break;
+        }
+        if (member.offset < cursor) {
+            std::cerr << "ERROR: member " << member.name << " of " << structName << " overlaps the previous member" << std::endl;
+        } else if (member.offset > cursor) {
+            ssBuilder << "\tuint8_t _pad" << padCount++ << "[" << member.offset - cursor << "];\n";
+        }
+
+        uint32_t elementSize = 0;
+        std::string typeName = GetBlockElementTypeAsString(member, INOUT_structs, nestedBuilder, elementSize);
+        uint32_t memberSize = elementSize;
+        std::ostringstream dimsBuilder;
+        if (member.array.dims_count > 0) {
+            uint32_t elementCount = 1;
+            for (uint32_t d = 0; d < member.array.dims_count; ++d) {
+                elementCount *= member.array.dims[d];
+                dimsBuilder << "[" << member.array.dims[d] << "]";
+            }
+            // e.g. std140 float/vec3 arrays, each element takes a whole vec4
+            if (member.array.stride != elementSize) {
+                typeName = "padded_elem<" + typeName + ", " + std::to_string(member.array.stride) + ">";
+                elementSize = member.array.stride;
+            }
+            memberSize = elementSize * elementCount;
         }
-        ssBuilder << "};\n";
+        ssBuilder << "\t" << typeName << " " << member.name << dimsBuilder.str() << ";\n";
+        assertBuilder << "static_assert(offsetof(" << structName << ", " << member.name << ") == " << member.offset << ");\n";
+        cursor = std::max(cursor, member.offset + memberSize);
     }
-    return ssBuilder.str();
+    if (targetSize > cursor && !hasRuntimeArray) {
+        ssBuilder << "\tuint8_t _pad" << padCount++ << "[" << targetSize - cursor << "];\n";
+        cursor = targetSize;
+    }
+    // C++ rounds the size up to the struct's alignment, e.g. { double; float; } is 16 bytes, not 12. std140/std430
+    // round a struct's size up to at least that alignment too, so the padding is spelled out to keep sizeof honest
+    uint32_t hostAlignment = GetHostAlignment(block);
+    if (cursor % hostAlignment != 0) {
+        uint32_t alignedSize = (cursor + hostAlignment - 1) / hostAlignment * hostAlignment;
+        ssBuilder << "\tuint8_t _pad" << padCount++ << "[" << alignedSize - cursor << "];\n";
+        cursor = alignedSize;
+    }
+    ssBuilder << "};\n";
+    outSize = cursor;
+    // A header with nothing before its runtime array is an empty struct, which C++ still gives a byte
+    if (outSize > 0 || !hasRuntimeArray)
+        assertBuilder << "static_assert(sizeof(" << structName << ") == " << outSize << ");\n";
+
+    return nestedBuilder.str() + ssBuilder.str() + assertBuilder.str();
 }
 
-std::string
-WriteInstanceInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars, const std::string &postfix) {
-    uint32_t binding = 1;
+std::string WriteBlockStruct(const SpvReflectBlockVariable &block, const std::string &structName, uint32_t alignment,
+                             StructRegistry &INOUT_structs, uint32_t sizeOverride) {
+    uint32_t size = 0;
+    return WriteStructAtOffsets(block, structName, alignment, sizeOverride ? sizeOverride : block.padded_size,
+                                INOUT_structs, size);
+}
+
+bool IsInstanceInput(const SpvReflectInterfaceVariable* inVar) {
+    std::string inName(inVar->name ? inVar->name : "");
+    return inName.size() >= 2 && inName[inName.size() - 1] == 'i' && inName[inName.size() - 2] == '_';
+}
+
+bool IsQuantizable(const SpvReflectInterfaceVariable* inVar) {
+    uint32_t flags = inVar->type_description->type_flags;
+    return (flags & SPV_REFLECT_TYPE_FLAG_FLOAT) && !(flags & SPV_REFLECT_TYPE_FLAG_MATRIX) && inVar->array.dims_count == 0;
+}
+
+uint32_t GetComponentCount(const SpvReflectInterfaceVariable* inVar) {
+    bool isVector = inVar->type_description->type_flags & SPV_REFLECT_TYPE_FLAG_VECTOR;
+    return isVector ? inVar->numeric.vector.component_count : 1;
+}
+
+AttributeQuantization FindQuantization(const SpvReflectInterfaceVariable* inVar, const AttributeQuantizations& quantizedInputs) {
+    if (!IsQuantizable(inVar)) return AttributeQuantization::NONE;
+    for (const auto& [name, quantization] : quantizedInputs)
+        if (name == inVar->name) return quantization;
+    return AttributeQuantization::NONE;
+}
+
+bool ValidateQuantizedInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars,
+                             const AttributeQuantizations &quantizedInputs, const std::string &pipelineName) {
+    bool isValid = true;
+    for (const auto& [name, quantization] : quantizedInputs) {
+        auto it = std::find_if(inputVars.begin(), inputVars.end(),
+                               [&name](const SpvReflectInterfaceVariable* inVar) { return name == inVar->name; });
+        if (it == inputVars.end()) {
+            std::cerr << "ERROR: " << pipelineName << " quantizes " << name << ", which is not an input of its vertex stage" << std::endl;
+            isValid = false;
+        } else if (quantization != AttributeQuantization::NONE && !IsQuantizable(*it)) {
+            std::cerr << "ERROR: " << pipelineName << " quantizes " << name << ", only float scalar and vector inputs can be "
+                      << "quantized, keeping its full precision format" << std::endl;
+            isValid = false;
+        }
+    }
+    return isValid;
+}
+
+std::string GetQuantizedFormatAsString(AttributeQuantization quantization, uint32_t componentCount) {
+    // 3 component 8 and 16 bit formats are rarely supported for vertex buffers, those get a 4th component
+    const char* channels[] = { "R", "G", "B", "A" };
+    uint32_t bits = 0;
+    const char* suffix = "";
+    switch (quantization) {
+        case AttributeQuantization::HALF:    bits = 16; suffix = "SFLOAT"; break;
+        case AttributeQuantization::SNORM16: bits = 16; suffix = "SNORM"; break;
+        case AttributeQuantization::UNORM16: bits = 16; suffix = "UNORM"; break;
+        case AttributeQuantization::SNORM8:  bits = 8;  suffix = "SNORM"; break;
+        case AttributeQuantization::UNORM8:  bits = 8;  suffix = "UNORM"; break;
+        default: return "VK_FORMAT_UNDEFINED";
+    }
     std::ostringstream ssBuilder;
-    std::vector<std::pair<uint32_t, SpvReflectInterfaceVariable*>> vertexInputs;
-    for (auto inVar : inputVars) {
-        std::string inName(inVar->name);
-        if (inName[inName.size() - 1] != 'i' || inName[inName.size() - 2] != '_') continue;
-        vertexInputs.emplace_back(inVar->location, inVar);
+    ssBuilder << "VK_FORMAT_";
+    for (uint32_t c = 0; c < (componentCount == 3 ? 4 : componentCount); ++c) ssBuilder << channels[c] << bits;
+    ssBuilder << "_" << suffix;
+    return ssBuilder.str();
+}
+
+/** Component type and kernel (see IN_VertexPacking.h) of a quantized member */
+std::pair<const char*, const char*> GetQuantizedTypeAndKernel(AttributeQuantization quantization) {
+    switch (quantization) {
+        case AttributeQuantization::HALF:    return { "uint16_t", "PackHalf" };
+        case AttributeQuantization::SNORM16: return { "int16_t", "PackSnorm16" };
+        case AttributeQuantization::UNORM16: return { "uint16_t", "PackUnorm16" };
+        case AttributeQuantization::SNORM8:  return { "int8_t", "PackSnorm8" };
+        case AttributeQuantization::UNORM8:  return { "uint8_t", "PackUnorm8" };
+        default: return { "float", "" };
     }
-    std::sort(vertexInputs.begin(), vertexInputs.end());
-    std::string structName(postfix + "Instance");
+}
+
+/**
+ * A struct holding inputs interleaved, and the binding and attribute table reading it from one vertex buffer.
+ * With quantized inputs also the full-precision <struct>Source and Pack<struct> filling the struct from it.
+ */
+std::string WriteInputStream(std::vector<std::pair<uint32_t, SpvReflectInterfaceVariable*>> inputs,
+                             const std::string& structName, uint32_t binding, bool isPerInstance,
+                             const AttributeQuantizations& quantizedInputs) {
+    std::ostringstream ssBuilder;
+    std::sort(inputs.begin(), inputs.end());
+    bool isQuantized = false;
     ssBuilder << "struct " << structName << " {\n";
-    for (auto [i, inVar] : vertexInputs) {
-        ssBuilder << "\t" << GetTypeAsString(inVar) << " " << inVar->name << ";\n";
+    for (auto [i, inVar] : inputs) {
+        AttributeQuantization quantization = FindQuantization(inVar, quantizedInputs);
+        if (quantization == AttributeQuantization::NONE) {
+            ssBuilder << "\t" << GetTypeAsString(inVar) << " " << inVar->name << ";\n";
+            continue;
+        }
+        uint32_t componentCount = GetComponentCount(inVar);
+        ssBuilder << "\t" << GetQuantizedTypeAndKernel(quantization).first << " " << inVar->name
+                  << "[" << (componentCount == 3 ? 4 : componentCount) << "];\n";
+        isQuantized = true;
     }
 
     ssBuilder << "};\n\n";
-    ssBuilder << "VkVertexInputBindingDescription " << structName << "InputBinding {\n";
+    ssBuilder << "inline constexpr VkVertexInputBindingDescription " << structName << "InputBinding {\n";
     ssBuilder << "\t.binding = " << binding << ",\n";
     ssBuilder << "\t.stride = sizeof(" << structName << "),\n";
-    ssBuilder << "\t.inputRate = VK_VERTEX_INPUT_RATE_VERTEX\n";
+    ssBuilder << "\t.inputRate = " << (isPerInstance ? "VK_VERTEX_INPUT_RATE_INSTANCE" : "VK_VERTEX_INPUT_RATE_VERTEX") << "\n";
     ssBuilder << "};\n\n";
 
-    ssBuilder << "std::array<VkVertexInputAttributeDescription, " << vertexInputs.size() << "> " << structName << "VertAttribs {\n";
-    for (auto [i, inVar] : vertexInputs) {
+    ssBuilder << "inline constexpr std::array<VkVertexInputAttributeDescription, " << inputs.size() << "> " << structName << "VertAttribs {\n";
+    for (auto [i, inVar] : inputs) {
+        AttributeQuantization quantization = FindQuantization(inVar, quantizedInputs);
         ssBuilder << "\tVkVertexInputAttributeDescription {\n";
         ssBuilder << "\t\t.location = " <<  inVar->location << ",\n";
         ssBuilder << "\t\t.binding = " <<  binding << ",\n";
-        ssBuilder << "\t\t.format = " << GetFormatAsString(inVar->format) << ",\n";
+        ssBuilder << "\t\t.format = " << (quantization == AttributeQuantization::NONE ? GetFormatAsString(inVar->format)
+                : GetQuantizedFormatAsString(quantization, GetComponentCount(inVar))) << ",\n";
         ssBuilder << "\t\t.offset = " << "offsetof(" << structName << ", " << inVar->name << "),\n";
         ssBuilder << "\t},\n";
     }
     ssBuilder << "};\n";
+    if (!isQuantized) return ssBuilder.str();
+
+    ssBuilder << "\n/* Full-precision arrays, one element per " << (isPerInstance ? "instance" : "vertex")
+              << ", that Pack" << structName << " packs into a " << structName << " stream */\n";
+    ssBuilder << "struct " << structName << "Source {\n";
+    for (auto [i, inVar] : inputs) {
+        ssBuilder << "\tconst " << GetTypeAsString(inVar) << "* " << inVar->name << ";\n";
+    }
+    ssBuilder << "};\n\n";
+    ssBuilder << "inline void Pack" << structName << "(const " << structName << "Source& src, " << structName
+              << "* dst, size_t count) {\n";
+    ssBuilder << "\tauto* bytes = reinterpret_cast<uint8_t*>(dst);\n";
+    for (auto [i, inVar] : inputs) {
+        AttributeQuantization quantization = FindQuantization(inVar, quantizedInputs);
+        if (quantization == AttributeQuantization::NONE) {
+            ssBuilder << "\tfor (size_t i = 0; i < count; ++i) dst[i]." << inVar->name << " = src." << inVar->name << "[i];\n";
+            continue;
+        }
+        uint32_t componentCount = GetComponentCount(inVar);
+        auto [componentType, kernel] = GetQuantizedTypeAndKernel(quantization);
+        ssBuilder << "\tPackAttribute<" << componentType << ", " << componentCount << ", " << (componentCount == 3 ? 4 : componentCount)
+                  << ", " << kernel << ">(reinterpret_cast<const float*>(src." << inVar->name << "), count, bytes, sizeof("
+                  << structName << "), offsetof(" << structName << ", " << inVar->name << "));\n";
+    }
+    ssBuilder << "}\n";
     return ssBuilder.str();
 }
 
-std::string WriteVertexInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars, const std::string &postfix) {
-    uint32_t binding = 0;
-    std::ostringstream ssBuilder;
-    std::vector<std::pair<uint32_t, SpvReflectInterfaceVariable*>> vertexInputs;
+uint32_t CountVertexStreams(const std::vector<SpvReflectInterfaceVariable *> &inputVars,
+                            const std::vector<VertexStreamConfig> &streams) {
+    if (streams.empty()) return 1;
+    uint32_t streamed = 0, perVertex = 0;
     for (auto inVar : inputVars) {
-        std::string inName(inVar->name);
-        if (inName[inName.size() - 1] == 'i' && inName[inName.size() - 2] == '_') continue;
-        vertexInputs.emplace_back(inVar->location, inVar);
+        if (IsInstanceInput(inVar)) continue;
+        ++perVertex;
+        for (const auto& stream : streams)
+            if (std::find(stream.inputs.begin(), stream.inputs.end(), inVar->name) != stream.inputs.end()) { ++streamed; break; }
     }
-    std::sort(vertexInputs.begin(), vertexInputs.end());
-    std::string structName(postfix + "Vertex");
-    ssBuilder << "struct " << structName << " {\n";
-    for (auto [i, inVar] : vertexInputs) {
-        ssBuilder << "\t" << GetTypeAsString(inVar) << " " << inVar->name << ";\n";
+    return static_cast<uint32_t>(streams.size()) + (streamed < perVertex ? 1 : 0);
+}
+
+std::vector<std::string> GetVertexInputStreamNames(const std::vector<SpvReflectInterfaceVariable *> &inputVars,
+                                                   const std::string &postfix, const std::vector<VertexStreamConfig> &streams) {
+    // Same assignment as WriteVertexInputs, the first stream naming an input reads it
+    std::vector<bool> isStreamUsed(streams.size(), false);
+    bool hasRemainingInputs = false, hasInstanceInputs = false;
+    for (auto inVar : inputVars) {
+        if (IsInstanceInput(inVar)) {
+            hasInstanceInputs = true;
+            continue;
+        }
+        auto stream = std::find_if(streams.begin(), streams.end(), [inVar](const VertexStreamConfig& s) {
+            return std::find(s.inputs.begin(), s.inputs.end(), inVar->name) != s.inputs.end();
+        });
+        if (stream == streams.end()) hasRemainingInputs = true;
+        else isStreamUsed[stream - streams.begin()] = true;
+    }
+    std::vector<std::string> names;
+    for (uint32_t s = 0; s < streams.size(); ++s)
+        if (isStreamUsed[s]) names.push_back(postfix + streams[s].name + "Vertex");
+    if (hasRemainingInputs) names.push_back(postfix + "Vertex");
+    if (hasInstanceInputs) names.push_back(postfix + "Instance");
+    return names;
+}
+
+std::string
+WriteInstanceInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars, const std::string &postfix,
+                    uint32_t binding, const AttributeQuantizations &quantizedInputs) {
+    std::vector<std::pair<uint32_t, SpvReflectInterfaceVariable*>> instanceInputs;
+    for (auto inVar : inputVars) {
+        if (!IsInstanceInput(inVar)) continue;
+        instanceInputs.emplace_back(inVar->location, inVar);
     }
+    return WriteInputStream(instanceInputs, postfix + "Instance", binding, true, quantizedInputs);
+}
 
-    ssBuilder << "};\n\n";
-    ssBuilder << "VkVertexInputBindingDescription " << structName << "InputBinding {\n";
-    ssBuilder << "\t.binding = " << binding << ",\n";
-    ssBuilder << "\t.stride = sizeof(" << structName << "),\n";
-    ssBuilder << "\t.inputRate = VK_VERTEX_INPUT_RATE_VERTEX\n";
-    ssBuilder << "};\n\n";
+std::string WriteVertexInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars, const std::string &postfix,
+                              const std::vector<VertexStreamConfig> &streams, const AttributeQuantizations &quantizedInputs) {
+    std::vector<std::vector<std::pair<uint32_t, SpvReflectInterfaceVariable*>>> streamInputs(streams.size());
+    std::vector<std::pair<uint32_t, SpvReflectInterfaceVariable*>> remainingInputs;
+    for (auto inVar : inputVars) {
+        if (IsInstanceInput(inVar)) continue;
+        bool isStreamed = false;
+        for (uint32_t s = 0; s < streams.size(); ++s) {
+            const auto& names = streams[s].inputs;
+            if (std::find(names.begin(), names.end(), inVar->name) == names.end()) continue;
+            if (isStreamed) {
+                std::cerr << "ERROR: vertex input " << inVar->name << " of " << postfix << " is listed in several streams, "
+                          << "only the first one reads it" << std::endl;
+                break;
+            }
+            streamInputs[s].emplace_back(inVar->location, inVar);
+            isStreamed = true;
+        }
+        if (!isStreamed) remainingInputs.emplace_back(inVar->location, inVar);
+    }
+    for (uint32_t s = 0; s < streams.size(); ++s) {
+        for (const auto& name : streams[s].inputs) {
+            bool isDeclared = std::any_of(inputVars.begin(), inputVars.end(), [&name](const SpvReflectInterfaceVariable* inVar) {
+                return !IsInstanceInput(inVar) && name == inVar->name;
+            });
+            if (!isDeclared) {
+                std::cerr << "ERROR: vertex stream " << streams[s].name << " of " << postfix << " lists " << name
+                          << ", which is not a per-vertex input of its vertex stage" << std::endl;
+            }
+        }
+    }
 
-    ssBuilder << "std::array<VkVertexInputAttributeDescription, " << vertexInputs.size() << "> " << structName << "VertAttribs {\n";
-    for (auto [i, inVar] : vertexInputs) {
-        ssBuilder << "\tVkVertexInputAttributeDescription {\n";
-        ssBuilder << "\t\t.location = " <<  inVar->location << ",\n";
-        ssBuilder << "\t\t.binding = " <<  binding << ",\n";
-        ssBuilder << "\t\t.format = " << GetFormatAsString(inVar->format) << ",\n";
-        ssBuilder << "\t\t.offset = " << "offsetof(" << structName << ", " << inVar->name << "),\n";
-        ssBuilder << "\t},\n";
+    // Streams take bindings 0..n-1 in order, the inputs no stream names follow in the plain <postfix>Vertex stream
+    std::ostringstream ssBuilder;
+    uint32_t binding = 0;
+    for (uint32_t s = 0; s < streams.size(); ++s) {
+        ssBuilder << WriteInputStream(streamInputs[s], postfix + streams[s].name + "Vertex", binding++, false, quantizedInputs);
+        ssBuilder << "\n";
+    }
+    if (streams.empty() || !remainingInputs.empty()) {
+        ssBuilder << WriteInputStream(remainingInputs, postfix + "Vertex", binding++, false, quantizedInputs);
     }
-    ssBuilder << "};\n";
     return ssBuilder.str();
 }
 
@@ -301,6 +807,73 @@ std::string GetFormatAsString(SpvReflectFormat format) {
     }
 }
 
+std::string GetBindingFlagsAsString(uint32_t bindingFlags) {
+    const std::pair<uint32_t, const char*> flagNames[] = {
+            { BINDING_FLAG_UPDATE_AFTER_BIND,           "VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT" },
+            { BINDING_FLAG_UPDATE_UNUSED_WHILE_PENDING, "VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT" },
+            { BINDING_FLAG_PARTIALLY_BOUND,             "VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT" },
+            { BINDING_FLAG_VARIABLE_DESCRIPTOR_COUNT,   "VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT" },
+    };
+    std::ostringstream ssBuilder;
+    for (const auto& [bit, name] : flagNames) {
+        if (!(bindingFlags & bit)) continue;
+        if (ssBuilder.tellp() > 0) ssBuilder << " | ";
+        ssBuilder << name;
+    }
+    if (ssBuilder.tellp() == 0) return "0";
+    return "VkDescriptorBindingFlags(" + ssBuilder.str() + ")";
+}
+
+std::string GetLayoutFlagsAsString(const uint32_t *bindingFlags, uint32_t bindingCount,
+                                   const std::vector<std::string> &userLayoutFlags) {
+    std::vector<std::string> flagNames = userLayoutFlags;
+    // The EXT alias is the same bit
+    const std::string updateAfterBindPool = "VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT";
+    bool needsUpdateAfterBindPool = bindingFlags && std::any_of(bindingFlags, bindingFlags + bindingCount,
+                                                                [](uint32_t flags) { return flags & BINDING_FLAG_UPDATE_AFTER_BIND; });
+    bool hasUpdateAfterBindPool = std::any_of(flagNames.begin(), flagNames.end(), [&](const std::string& name) {
+        return name.rfind(updateAfterBindPool, 0) == 0;
+    });
+    if (needsUpdateAfterBindPool && !hasUpdateAfterBindPool) flagNames.push_back(updateAfterBindPool);
+    if (flagNames.empty()) return "0";
+    std::ostringstream ssBuilder;
+    for (size_t i = 0; i < flagNames.size(); ++i) ssBuilder << (i ? " | " : "") << flagNames[i];
+    return "VkDescriptorSetLayoutCreateFlags(" + ssBuilder.str() + ")";
+}
+
+std::string GetStageFlagsAsString(uint32_t stageMask) {
+    const uint32_t allGraphics = SPV_REFLECT_SHADER_STAGE_VERTEX_BIT | SPV_REFLECT_SHADER_STAGE_TESSELLATION_CONTROL_BIT |
+            SPV_REFLECT_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | SPV_REFLECT_SHADER_STAGE_GEOMETRY_BIT |
+            SPV_REFLECT_SHADER_STAGE_FRAGMENT_BIT;
+    if (stageMask == allGraphics) return "VK_SHADER_STAGE_ALL_GRAPHICS";
+    const std::pair<uint32_t, const char*> stageNames[] = {
+            { SPV_REFLECT_SHADER_STAGE_VERTEX_BIT,                  "VK_SHADER_STAGE_VERTEX_BIT" },
+            { SPV_REFLECT_SHADER_STAGE_TESSELLATION_CONTROL_BIT,    "VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT" },
+            { SPV_REFLECT_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, "VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT" },
+            { SPV_REFLECT_SHADER_STAGE_GEOMETRY_BIT,                "VK_SHADER_STAGE_GEOMETRY_BIT" },
+            { SPV_REFLECT_SHADER_STAGE_FRAGMENT_BIT,                "VK_SHADER_STAGE_FRAGMENT_BIT" },
+            { SPV_REFLECT_SHADER_STAGE_COMPUTE_BIT,                 "VK_SHADER_STAGE_COMPUTE_BIT" },
+            { SPV_REFLECT_SHADER_STAGE_TASK_BIT_EXT,                "VK_SHADER_STAGE_TASK_BIT_EXT" },
+            { SPV_REFLECT_SHADER_STAGE_MESH_BIT_EXT,                "VK_SHADER_STAGE_MESH_BIT_EXT" },
+    };
+    std::ostringstream ssBuilder;
+    for (const auto& [bit, name] : stageNames) {
+        if (!(stageMask & bit)) continue;
+        if (ssBuilder.tellp() > 0) ssBuilder << " | ";
+        ssBuilder << name;
+        stageMask &= ~bit;
+    }
+    if (stageMask != 0) { // Ray tracing etc, same bit values in Vulkan
+        if (ssBuilder.tellp() > 0) ssBuilder << " | ";
+        ssBuilder << "VkShaderStageFlags(0x" << std::hex << stageMask << std::dec << ")";
+    }
+    if (ssBuilder.tellp() == 0) {
+        std::cerr << "ERROR: a binding is not used by any stage, making it visible to all graphics stages" << std::endl;
+        return "VK_SHADER_STAGE_ALL_GRAPHICS";
+    }
+    return ssBuilder.str();
+}
+
 std::string GetDescriptorTypeAsString(SpvReflectDescriptorType descType) {
     switch (descType) {
         case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLER:                    return "VK_DESCRIPTOR_TYPE_SAMPLER";
@@ -318,3 +891,20 @@ std::string GetDescriptorTypeAsString(SpvReflectDescriptorType descType) {
         default: return "Unknown descriptor type";
     }
 }
+
+std::string GetDescriptorInfoTypeAsString(SpvReflectDescriptorType descType) {
+    switch (descType) {
+        case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLER:
+        case SPV_REFLECT_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        case SPV_REFLECT_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:           return "VkDescriptorImageInfo";
+        case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:       return "VkBufferView";
+        case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:     return "VkDescriptorBufferInfo";
+        default: return "";
+    }
+}
@@ -0,0 +1,59 @@
+//
+// Indexed store of every reflected module in a generator run.
+//
+#include "main.h"
+
+
+ReflectionDatabase::~ReflectionDatabase() {
+    // Modules first, they point into their code
+    for (SpvReflectShaderModule* module : m_modules) {
+        spvReflectDestroyShaderModule(module);
+        delete module;
+    }
+    m_moduleCode.clear();
+}
+
+void ReflectionDatabase::AddModule(const std::string &filename, SpvReflectShaderModule *module, SpirvFileMapping code) {
+    assert(module != nullptr && !m_modulesByFilename.contains(filename));
+    m_modules.push_back(module);
+    m_moduleCode.push_back(std::move(code));
+    m_modulesByFilename.emplace(filename, module);
+
+    uint32_t count = 0;
+    auto result = spvReflectEnumerateDescriptorSets(module, &count, NULL);
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+    std::vector<SpvReflectDescriptorSet *> sets(count);
+    result = spvReflectEnumerateDescriptorSets(module, &count, sets.data());
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    for (SpvReflectDescriptorSet* set : sets) m_setsByModule.emplace(std::make_pair(module, set->set), set);
+}
+
+SpvReflectShaderModule *ReflectionDatabase::GetModule(const std::string &filename) const {
+    auto it = m_modulesByFilename.find(filename);
+    return it == m_modulesByFilename.end() ? nullptr : it->second;
+}
+
+SpvReflectDescriptorSet *ReflectionDatabase::GetDescSet(const SpvReflectShaderModule *module, uint32_t setID) const {
+    auto it = m_setsByModule.find(std::make_pair(module, setID));
+    return it == m_setsByModule.end() ? nullptr : it->second;
+}
+
+const SpirvFileMapping *ReflectionDatabase::GetCode(const std::string &filename) const {
+    SpvReflectShaderModule* module = GetModule(filename);
+    auto it = std::find(m_modules.begin(), m_modules.end(), module);
+    return it == m_modules.end() ? nullptr : &m_moduleCode[it - m_modules.begin()];
+}
+
+void ReflectionDatabase::RenumberBindings(SpvReflectDescriptorSet *set,
+                                          const std::vector<std::pair<uint32_t, uint32_t>> &newByOldBinding) {
+    // Every binding is looked up by its old number first, a new number may still be some other binding's old one
+    std::unordered_map<uint32_t, SpvReflectDescriptorBinding*> bindingsByNumber;
+    for (uint32_t b = 0; b < set->binding_count; ++b) bindingsByNumber.emplace(set->bindings[b]->binding, set->bindings[b]);
+    std::vector<std::pair<SpvReflectDescriptorBinding*, uint32_t>> renumbered;
+    for (const auto& [oldBinding, newBinding] : newByOldBinding) {
+        auto it = bindingsByNumber.find(oldBinding);
+        if (it != bindingsByNumber.end()) renumbered.emplace_back(it->second, newBinding);
+    }
+    for (auto [binding, newBinding] : renumbered) binding->binding = newBinding;
+}
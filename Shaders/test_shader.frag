@@ -15,12 +15,21 @@ layout(binding = 2, set = 0) uniform CameraView {
 layout(binding = 0, set = 1) uniform MatColor {
     vec3 col;
 } matColor;
-layout(binding = 1, set = 1) uniform Transform {
-    mat4 model[1024]; // TODO: This is a notably limitation of the into buffer solution
+layout(std430, binding = 1, set = 1) readonly buffer Transform {
+    mat4 model[]; // One per entity, as many as the buffer holds
 } matEntities;
+// 12 bytes of members, but std430 (and C++) give the struct its double's alignment: 16 bytes, stride 16
+struct ShadeSample {
+    double weight;
+    float bias;
+};
+layout(std430, binding = 2, set = 1) readonly buffer ShadeSamples {
+    float scale;
+    ShadeSample samples[4];
+} matSamples;
 
-// TODO: these ones need to be arrayed
-layout(binding = 0, set = 2) uniform sampler2D localImages[8];
+// Unsized, so --bindless can grow it, every index into it is nonuniformEXT
+layout(binding = 0, set = 2) uniform sampler2D localImages[];
 layout(binding = 1, set = 2) uniform  LocalColor {
     vec3 col;
     mat4x4 andBrittnay;
@@ -29,5 +38,5 @@ layout(binding = 1, set = 2) uniform  LocalColor {
 layout(location = 0) out vec4 fragInColor;
 
 void main() {
-    fragInColor = vec4(1, 1, 1, 1);
+    fragInColor = texture(localImages[nonuniformEXT(int(gl_FragCoord.x))], gl_FragCoord.xy);
 }
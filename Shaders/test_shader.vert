@@ -50,12 +50,12 @@ layout(binding = 2, set = 0) uniform CameraView {
 layout(binding = 0, set = 1) uniform MatColor {
     vec3 col;
 } matColor;
-layout(binding = 1, set = 1) uniform Transform {
-    mat4 model[1024]; // TODO: This is a notably limitation of the into buffer solution
+layout(std430, binding = 1, set = 1) readonly buffer Transform {
+    mat4 model[]; // One per entity, as many as the buffer holds
 } matEntities;
 
-// TODO: these ones need to be arrayed
-layout(binding = 0, set = 2) uniform sampler2D localImages[8];
+// Unsized, so --bindless can grow it, every index into it is nonuniformEXT
+layout(binding = 0, set = 2) uniform sampler2D localImages[];
 layout(binding = 1, set = 2) uniform  LocalColor {
     vec3 col;
     mat4x4 andBrittnay;
@@ -64,6 +64,7 @@ layout(binding = 1, set = 2) uniform  LocalColor {
 layout(location = 0) out vec3 fragInColor;
 
 void main() {
-    fragInColor = localColor[nonuniformEXT(matIndex_i)].col;
+    fragInColor = localColor[nonuniformEXT(matIndex_i)].col
+            * textureLod(localImages[nonuniformEXT(matIndex_i)], inUV, 0.0).rgb;
     gl_Position = matEntities.model[entityIndex_i] * vec4(inPos, 1.0);
 }
@@ -10,11 +10,11 @@ layout(binding = 0, set = 1) uniform MatColor {
     vec3 col;
 } matColor;
 
-// TODO: these ones need to be arrayed
-layout(binding = 0, set = 2) uniform sampler2D localImages[8];
+// Unsized, so --bindless can grow it, every index into it is nonuniformEXT
+layout(binding = 0, set = 2) uniform sampler2D localImages[];
 
 layout(location = 0) out vec4 fragInColor;
 
 void main() {
-    fragInColor = vec4(1, 1, 1, 1);
+    fragInColor = texture(localImages[nonuniformEXT(int(gl_FragCoord.x))], gl_FragCoord.xy);
 }
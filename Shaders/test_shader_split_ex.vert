@@ -19,8 +19,8 @@ layout(binding = 2, set = 0) uniform CameraView {
     mat4 viewProj;
 } camera;
 
-layout(binding = 1, set = 1) uniform Transform {
-    mat4 model[1024]; // TODO: This is a notably limitation of the into buffer solution
+layout(std430, binding = 1, set = 1) readonly buffer Transform {
+    mat4 model[]; // One per entity, as many as the buffer holds
 } matEntities;
 
 // TODO: these ones need to be arrayed
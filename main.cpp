@@ -19,6 +19,7 @@
 #include <iostream>
 #include <bitset>
 #include <memory>
+#include <unordered_set>
 #include "main.h"
 
 #include "SPIRV-Reflect/spirv_reflect.h"
@@ -27,20 +28,15 @@
 void ExampleParseSingleModule(const std::string& filename="test_shader_vert.spv") {
     std::string input_spv_path = SHADER_DIR + filename;
 
-    std::ifstream spv_ifstream(input_spv_path.c_str(), std::ios::binary);
-    if (!spv_ifstream.is_open()) {
+    SpirvFileMapping spv_data(input_spv_path);
+    if (!spv_data.IsValid()) {
         std::cerr << "ERROR: could not open '" << input_spv_path << "' for reading\n";
+        return;
     }
 
-    spv_ifstream.seekg(0, std::ios::end);
-    size_t size = static_cast<size_t>(spv_ifstream.tellg());
-    spv_ifstream.seekg(0, std::ios::beg);
-
-    std::vector<char> spv_data(size);
-    spv_ifstream.read(spv_data.data(), size);
-
     SpvReflectShaderModule module = {};
-    SpvReflectResult result = spvReflectCreateShaderModule(spv_data.size(), spv_data.data(), &module);
+    SpvReflectResult result = spvReflectCreateShaderModule2(SPV_REFLECT_MODULE_FLAG_NO_COPY,
+                                                            spv_data.ByteSize(), spv_data.Words(), &module);
     assert(result == SPV_REFLECT_RESULT_SUCCESS);
 
     // Go through each enumerate to examine it
@@ -96,35 +92,148 @@ void ExampleParseSingleModule(const std::string& filename="test_shader_vert.spv"
 
     reflectInputVariables(input_variables);
 
-    reflectDescriptorSets("TestExample", sets);
+    reflectDescriptorSets("TestExample", sets, module.shader_stage);
+
+    reflectPushConstants(push_constant, module.shader_stage);
 
     spvReflectDestroyShaderModule(&module);
 
 }
 
-void PerformShaderGen(const std::vector<GlobalDescriptorSet>& globalSetConfigs, const std::vector<PipelineConfig>& configs) {
+void PerformShaderGen(const std::vector<GlobalDescriptorSet>& globalSetConfigs, const std::vector<PipelineConfig>& configs,
+                      const ShaderGenOptions& options = {}) {
     auto globalSets = globalSetConfigs;
     auto pipelineConfigs = configs;
+    const std::string inputDataFilename = "InputData.h";
+    const std::string globalDescSetsFilename = "GlobalDescSetLayoutData.h";
+    const std::string materialDescSetsFilename = "MaterialDescSetLayoutData.h";
+    const std::string pushConstantsFilename = "PushConstantData.h";
+    const std::string layoutReportFilename = "PipelineLayoutReport.txt";
+    const std::string pipelinesFilename = "PipelineData.h";
+    std::vector<std::string> generatedFiles { inputDataFilename, globalDescSetsFilename, materialDescSetsFilename,
+                                              pushConstantsFilename, layoutReportFilename, pipelinesFilename };
+
+    // Step 0, nothing to do if no stage file, config or output changed since the last run
+    const std::string cachePath = std::string(OUT_DIR) + options.cacheFilename;
+    GenerationCache cache = MakeGenerationCacheInputs(globalSetConfigs, configs, options);
+    GenerationCache storedCache{};
+    if (options.useCache && LoadGenerationCache(cachePath, storedCache) && IsGenerationCacheUpToDate(cache, storedCache)) {
+        std::cout << "Generated files are up to date with " << cache.stageHashes.size() << " stage files, skipping" << std::endl;
+        return;
+    }
 
     // Step 1, get all the reflection modules
-    std::vector<std::pair<std::string, SpvReflectShaderModule*>> modules = CreateAllReflectModules(configs);
-    std::cout << "For this, we using at least: " << sizeof(SpvReflectShaderModule) * 2 * modules.size() << " bytes" << std::endl;
+    ReflectionDatabase database;
+    CreateAllReflectModules(configs, database, options.workerCount);
+    std::cout << "For this, we using at least: " << sizeof(SpvReflectShaderModule) * database.ModuleCount() << " bytes" << std::endl;
 
     // Step 1.5, union all the pipelines. NOTE: SAME ORDER AS THE PIPELINES, could change to explicitly mark iff needed
+    DescriptorSetArena setArena; // Owns every unioned set, released when generation is done
     std::vector<std::array<SpvReflectDescriptorSet*, MAX_DESCRIPTOR_SETS>> mergedSets = MergeModulesUnionDescriptorSetsByPipeline(configs,
-                                                                                                                modules);
+                                                                                                                database, setArena);
     // Step 2, build and generate global descriptor sets
     std::vector<std::pair<uint32_t, SpvReflectDescriptorSet*>> globalPartialSetsPerPipeline(configs.size());
     for (uint32_t i = 0; i < configs.size(); i++)
         globalPartialSetsPerPipeline[i] = { configs[i].globalDescSetID, mergedSets[i][GLOBAL_DESCSET_INDEX] };
-    PopulateGlobalDescriptorLayouts(globalPartialSetsPerPipeline, globalSets);
+    PopulateGlobalDescriptorLayouts(globalPartialSetsPerPipeline, globalSets, setArena);
+
+    // Step 2.5, bindings no stage uses, only after the global union so a binding used by any pipeline stays live
+    DeadBindingReport deadBindings{};
+    for (auto& globalSet : globalSets)
+        globalSet.descSet = EliminateDeadBindings(globalSet.descSet, options.deadBindings, setArena, deadBindings);
+    for (auto& pSets : mergedSets)
+        for (uint32_t i = 0; i < MAX_DESCRIPTOR_SETS; ++i)
+            if (pSets[i] && i != GLOBAL_DESCSET_INDEX)
+                pSets[i] = EliminateDeadBindings(pSets[i], options.deadBindings, setArena, deadBindings);
+
+    // Step 2.75, dense binding numbers, with patched copies of the stage files so the SPIR-V matches the headers
+    std::vector<std::string> patchedShaderFiles;
+    if (options.compactBindings) {
+        std::vector<ShaderBindingRemap> remaps = CompactBindings(configs, globalSets, mergedSets, database);
+        patchedShaderFiles = WritePatchedShaderModules(remaps, database, std::string(OUT_DIR) + options.patchedShaderDir,
+                                                       options.workerCount);
+        std::cout << "Compacted " << remaps.size() << " stage descriptor sets, patched " << patchedShaderFiles.size()
+                  << " stage files into " << OUT_DIR << options.patchedShaderDir << std::endl;
+        for (const auto& filename : patchedShaderFiles) generatedFiles.push_back(options.patchedShaderDir + filename);
+    }
+
+    // Step 2.8, bindless arrays, after compaction so the highest binding of each set (the only one that can have a
+    // variable count) is final
+    if (options.bindlessMinArraySize) {
+        uint32_t bindlessCount = 0;
+        for (auto& globalSet : globalSets)
+            bindlessCount += MakeBindlessBindings(globalSet.descSet, options.bindlessMinArraySize,
+                                                  options.bindlessDescriptorCount, setArena);
+        for (auto& pSets : mergedSets)
+            for (uint32_t i = 0; i < MAX_DESCRIPTOR_SETS; ++i)
+                if (pSets[i] && i != GLOBAL_DESCSET_INDEX)
+                    bindlessCount += MakeBindlessBindings(pSets[i], options.bindlessMinArraySize,
+                                                          options.bindlessDescriptorCount, setArena);
+        std::cout << "Made " << bindlessCount << " bindings bindless" << std::endl;
+    }
+
+    // Step 2.9, uniform buffers bound with dynamic offsets, per global and per pipeline
+    uint32_t dynamicCount = 0;
+    for (auto& globalSet : globalSets) {
+        std::unordered_set<std::string> unmatched(globalSet.dynamicUniforms.begin(), globalSet.dynamicUniforms.end());
+        dynamicCount += MakeDynamicUniforms(globalSet.descSet, unmatched, setArena);
+        for (const auto& name : unmatched)
+            std::cerr << "ERROR: global set " << globalSet.name << " has no uniform buffer " << name << " to make dynamic" << std::endl;
+    }
+    for (uint32_t p = 0; p < configs.size(); ++p) {
+        std::unordered_set<std::string> unmatched(configs[p].dynamicUniforms.begin(), configs[p].dynamicUniforms.end());
+        for (uint32_t i = 0; i < MAX_DESCRIPTOR_SETS; ++i)
+            if (mergedSets[p][i] && i != GLOBAL_DESCSET_INDEX)
+                dynamicCount += MakeDynamicUniforms(mergedSets[p][i], unmatched, setArena);
+        for (const auto& name : unmatched)
+            std::cerr << "ERROR: " << configs[p].pipelineName << " has no uniform buffer " << name << " to make dynamic" << std::endl;
+    }
+    if (dynamicCount) std::cout << "Made " << dynamicCount << " uniform buffers dynamic" << std::endl;
+
+    // Step 2.95, how many sets stay bound across pipeline switches with the final layouts, see WriteLayoutCompatibilityReport
+    std::vector<PipelineLayoutSignature> layoutSignatures(configs.size());
+    for (uint32_t p = 0; p < configs.size(); ++p) {
+        PipelineLayoutSignature& signature = layoutSignatures[p];
+        signature.pipelineName = configs[p].pipelineName;
+        for (uint32_t i = 0; i < MAX_DESCRIPTOR_SETS; ++i) {
+            signature.sets[i] = mergedSets[p][i];
+            if (i == GLOBAL_DESCSET_INDEX) {
+                uint32_t gid = configs[p].globalDescSetID;
+                auto global = std::find_if(globalSets.begin(), globalSets.end(),
+                                           [gid](const GlobalDescriptorSet& g) { return g.globalDescSetID == gid; });
+                if (global != globalSets.end()) signature.sets[i] = global->descSet;
+            }
+            if (signature.sets[i] == nullptr) continue;
+            const uint32_t* bindingFlags = setArena.GetBindingFlags(signature.sets[i]);
+            uint32_t bindingCount = signature.sets[i]->binding_count;
+            signature.setKeys[i] = GetSetCompatibilityKey(signature.sets[i], setArena, i == GLOBAL_DESCSET_INDEX
+                    ? GetLayoutFlagsAsString(bindingFlags, bindingCount)
+                    : GetLayoutFlagsAsString(bindingFlags, bindingCount, configs[p].layoutFlags));
+        }
+        MergedPushConstants pushConstants;
+        MergePipelinePushConstants(configs[p], database, pushConstants);
+        signature.pushConstantKey = GetPushConstantKey(pushConstants);
+    }
+    std::vector<uint32_t> drawOrder;
+    for (const auto& name : options.drawOrder) {
+        auto it = std::find_if(configs.begin(), configs.end(), [&name](const PipelineConfig& p) { return p.pipelineName == name; });
+        if (it == configs.end()) std::cerr << "ERROR: draw order names unknown pipeline " << name << std::endl;
+        else drawOrder.push_back(static_cast<uint32_t>(it - configs.begin()));
+    }
+    if (options.drawOrder.empty())
+        for (uint32_t p = 0; p < configs.size(); ++p) drawOrder.push_back(p);
+    uint32_t rebinds = 0, recommendedRebinds = 0;
+    WriteFileIfChanged(std::string(OUT_DIR) + layoutReportFilename,
+                       WriteLayoutCompatibilityReport(layoutSignatures, drawOrder, rebinds, recommendedRebinds));
+    std::cout << "Pipeline switches rebind " << rebinds << " descriptor sets, " << recommendedRebinds
+              << " in the draw order proposed in " << layoutReportFilename << std::endl;
 
     // Step 3, build and generate inputs for VERTEX shaders, remember to opt out compute shaders
-    GenerateInputVariableFile(configs, modules, "InputData.h");
+    GenerateInputVariableFile(configs, database, inputDataFilename);
 
     // Step 4, build and generate descriptor sets for global descriptor sets
     auto generatedStructs =
-    GenerateGlobalDescriptorSetsFile(globalSets, globalPartialSetsPerPipeline, "GlobalDescSetLayoutData.h");
+    GenerateGlobalDescriptorSetsFile(globalSets, setArena, globalDescSetsFilename, options.framesInFlight);
 
     // Step 4.5, populate the global desc names of the pipeline config objects
     for (auto & pc : pipelineConfigs) {
@@ -136,88 +245,136 @@ void PerformShaderGen(const std::vector<GlobalDescriptorSet>& globalSetConfigs,
 
     // Step 5, build and generate descriptor sets for per-pipeline (exclude the global index)
     auto generatedStructs2 =
-    GenerateMaterialDescriptorSetsFile(pipelineConfigs, mergedSets, "MaterialDescSetLayoutData.h");
+    GenerateMaterialDescriptorSetsFile(pipelineConfigs, mergedSets, setArena, materialDescSetsFilename,
+                                       options.framesInFlight);
+
 
+    // Step 5.5, push constants of every pipeline, merged over its stages
+    auto generatedStructs3 =
+    GeneratePushConstantFile(pipelineConfigs, database, pushConstantsFilename);
+
+    // Step 5.75, a constexpr descriptor per pipeline on top of all of the above, and the manifest of all of them
+    GeneratePipelineFile(pipelineConfigs, layoutSignatures, database, cache.stageHashes, patchedShaderFiles,
+                         pipelinesFilename);
 
     // STEP !!! the material guts...
 
 
-    // ALLOC CLEANUP, not pretty... TODO: need some RAII in this bitch
+    // SUMMARY, the sets themselves are released with setArena
     std::cout << mergedSets.size() << " made from " << configs.size() << std::endl;
     for (auto darr : mergedSets) for (auto d : darr) {
             if (d) std::cout << "Made desc set #" << d->set << " for " << d->binding_count << " bindings" << std::endl;
             else std::cout << "No desc set for #X" << std::endl;
-            FreeUnionDescSet(d);
     }
     for (const auto& globalDesc : globalSets) {
         std::cout << "Made the global desc " << globalDesc.name << " (ID=" << globalDesc.globalDescSetID << ") "
             << "with " << globalDesc.descSet->binding_count << " bindings" << std::endl;
-        FreeUnionDescSet(globalDesc.descSet);
     }
-    FreeReflectModules(modules);
+    if (options.deadBindings != DeadBindingMode::KEEP) {
+        std::cout << (options.deadBindings == DeadBindingMode::DROP ? "Dropped " : "Flagged partially bound ")
+                  << deadBindings.bindings << " dead bindings, saving " << deadBindings.descriptors << " descriptors and "
+                  << deadBindings.bufferBytes << " bytes of buffer data" << std::endl;
+    }
 
+    // Step 6, tell the build system what each generated file was made from
+    std::vector<std::pair<std::string, std::vector<std::string>>> depfileRules;
+    std::vector<std::string> allStageFiles, vertexStageFiles;
+    for (const auto& [filename, hash] : cache.stageHashes) allStageFiles.push_back(SHADER_DIR + filename);
+    for (const auto& p : configs) {
+        auto it = std::find_if(p.stages.begin(), p.stages.end(),
+                               [](const StageDescriptor& stage) { return stage.stageType == SPV_REFLECT_SHADER_STAGE_VERTEX_BIT; });
+        std::string path = it == p.stages.end() ? "" : SHADER_DIR + it->filename;
+        if (!path.empty() && std::find(vertexStageFiles.begin(), vertexStageFiles.end(), path) == vertexStageFiles.end())
+            vertexStageFiles.push_back(path);
+    }
+    const std::string baseDescsBoilerplate = std::string(BOILERPLATE_DIR) + "IN_BaseDescs.h";
+    const std::string descSetLayoutsBoilerplate = std::string(BOILERPLATE_DIR) + "IN_DescSetLayouts.h";
+    vertexStageFiles.push_back(baseDescsBoilerplate);
+    allStageFiles.push_back(baseDescsBoilerplate);
+    allStageFiles.push_back(descSetLayoutsBoilerplate);
+    depfileRules.emplace_back(std::string(OUT_DIR) + inputDataFilename, vertexStageFiles);
+    // Global sets are unions over every pipeline, and material structs are deduplicated across all of them
+    depfileRules.emplace_back(std::string(OUT_DIR) + globalDescSetsFilename, allStageFiles);
+    depfileRules.emplace_back(std::string(OUT_DIR) + materialDescSetsFilename, allStageFiles);
+    depfileRules.emplace_back(std::string(OUT_DIR) + pushConstantsFilename, allStageFiles);
+    depfileRules.emplace_back(std::string(OUT_DIR) + pipelinesFilename, allStageFiles);
+    // Compaction of a stage depends on the merge of every stage it shares a set with
+    for (const auto& filename : patchedShaderFiles)
+        depfileRules.emplace_back(std::string(OUT_DIR) + options.patchedShaderDir + filename, allStageFiles);
+    std::string depfilePath = options.depfilePath.empty() ? std::string(OUT_DIR) + "ShaderGen.d" : options.depfilePath;
+    WriteFileIfChanged(depfilePath, WriteDepfile(depfileRules));
+
+    // Remember what this run consumed and produced
+    RecordGenerationCacheOutputs(cache, generatedFiles);
+    SaveGenerationCache(cachePath, cache);
 }
 
 
-std::vector<std::string>  GenerateMaterialDescriptorSetsFile(std::vector<PipelineConfig> &configs,
+std::unordered_set<std::string> GenerateMaterialDescriptorSetsFile(std::vector<PipelineConfig> &configs,
                                         const std::vector<std::array<SpvReflectDescriptorSet *, 4>> &unionedDescSets,
-                                        const std::string& filename) {
+                                        const DescriptorSetArena &arena,
+                                        const std::string& filename, uint32_t framesInFlight) {
     assert(configs.size() == unionedDescSets.size());
 
-    std::ofstream outFile(std::string(OUT_DIR) + filename);
-    if (!outFile.is_open()) {
-        std::cerr << "Failed to open the file." << std::endl;
-    }
+    std::ostringstream outFile; // Only replaces the file on disk if the contents changed, see WriteFileIfChanged
 
     std::string boilerInputFilename = "IN_InputData.h";
     std::string boilerDescSetFilename = "IN_DescSetLayoutHeader.h";
+    outFile << "#pragma once\n";
     outFile << "#include \"" << boilerInputFilename << "\"\n";
     outFile << "#include \"" << boilerDescSetFilename << "\"\n\n";
 
 
-    // TODO: makes the grave assumption that structs with identical names will have identical members, this isn't necessarily true AND can be checked in future
+    // Structs are deduplicated by name AND layout, see StructRegistry
     outFile << "/********************************************************************************************\n";
     outFile << "****************************     " << "STRUCTS!!!!" << "     ******************************\n";
     outFile << "*********************************************************************************************/\n\n";
-    std::vector<std::string> declaredStructs;
+    StructRegistry declaredStructs;
     for (const auto& pSets : unionedDescSets) {
         for (const auto* set : pSets) {
             if (set == nullptr || set->set == GLOBAL_DESCSET_INDEX) continue;
             std::vector<SpvReflectDescriptorBinding *> bindings(set->bindings, set->bindings + set->binding_count);
             outFile << WriteUsedStructsInDescSet(bindings, declaredStructs) << "\n\n";
-            for (SpvReflectDescriptorBinding *binding: bindings) {
-                if (binding->descriptor_type == SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
-                    declaredStructs.emplace_back(binding->type_description->type_name);
-            }
         }
     }
 
     std::vector<std::string> postfixBySetID { "GLOBAL", "MAT", "LOCAL", "UNKNOWN" };
     std::vector<std::vector<SpvReflectDescriptorBinding*>> bindingsToSet_forDebug;
+    std::unordered_map<std::string, std::string> canonicalSetNames; // GetSetLayoutKey -> first set written with it
+    uint32_t aliasCount = 0;
     for (uint32_t i = 0; i < configs.size(); ++i) {
         auto& p = configs[i];
         const auto& pSets = unionedDescSets[i];
         for (SpvReflectDescriptorSet* set: pSets) {
             if (set == nullptr || set->set == GLOBAL_DESCSET_INDEX) continue;
             std::string setName = configs[i].pipelineName + "_" + postfixBySetID[set->set];
+            std::string layoutFlags = GetLayoutFlagsAsString(arena.GetBindingFlags(set), set->binding_count, p.layoutFlags);
+            p.descSetManagerNames[set->set] = setName + "_IMPL";
+
+            // A set identical to one already written is the same type under another name, so it shares its layout
+            auto [canonical, isNew] = canonicalSetNames.try_emplace(GetSetLayoutKey(set, arena, declaredStructs, layoutFlags), setName);
+            if (!isNew) {
+                outFile << "\n/* " << setName << " is identical to " << canonical->second << " */\n";
+                outFile << "typedef " << canonical->second << "_IMPL " << p.descSetManagerNames[set->set] << ";\n";
+                outFile << WriteFramedDescSetTypedef(p.descSetManagerNames[set->set], framesInFlight);
+                aliasCount++;
+                continue;
+            }
 
             outFile << "\n\n\n/********************************************************************************************\n";
             outFile << "****************************     " << setName << "     ******************************\n";
             outFile << "*********************************************************************************************/\n\n\n";
 
             std::vector<SpvReflectDescriptorBinding *> setBindings(set->bindings, set->bindings + set->binding_count);
-            outFile << WriteDescSetLayout(setBindings, setName) << "\n\n";
+            outFile << WriteDescSetLayout(setBindings, setName, &declaredStructs, arena.GetBindingFlags(set)) << "\n\n";
 
-            p.descSetManagerNames[set->set] = setName + "_IMPL";
-            outFile << "typedef " << setName << "_DescriptorSet<";
-            uint32_t numBindings = set->binding_count;
-            for (uint32_t i = 0; i < numBindings; ++i) {
-                outFile << "VK_SHADER_STAGE_ALL_GRAPHICS, ";
-            }
-            outFile << "VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT> " << p.descSetManagerNames[set->set] << ";\n";
+            outFile << WriteDescSetTypedef(setName, arena.GetStageMaskList(set), p.descSetManagerNames[set->set], layoutFlags);
+            outFile << WriteFramedDescSetTypedef(p.descSetManagerNames[set->set], framesInFlight);
         }
     }
-    return declaredStructs;
+    if (aliasCount) std::cout << "Aliased " << aliasCount << " material sets to identical ones" << std::endl;
+    WriteFileIfChanged(std::string(OUT_DIR) + filename, outFile.str());
+    return declaredStructs.GetEmittedNames();
 }
 
 /**
@@ -225,90 +382,124 @@ std::vector<std::string>  GenerateMaterialDescriptorSetsFile(std::vector<Pipelin
  * @param globalConfigs MODIFIES, WRITES TO managerName WHICH WILL BE THE NAME OF THE DECLARED MANAGER TYPE using typedef
  * @param reflectedGlobalDescSets
  * @param filename
- * @return The names of all structs generated by this function and put into the file. There are likely to be duplicates.
+ * @return The names of all structs generated by this function and put into the file.
  */
-std::vector<std::string> GenerateGlobalDescriptorSetsFile(std::vector<GlobalDescriptorSet> &globalConfigs,
-                                      const std::vector<std::pair<uint32_t, SpvReflectDescriptorSet *>> &reflectedGlobalDescSets,
-                                      const std::string& filename) {
-    std::ofstream outFile(std::string(OUT_DIR) + filename);
-    if (!outFile.is_open()) {
-        std::cerr << "Failed to open the file." << std::endl;
-    }
+std::unordered_set<std::string> GenerateGlobalDescriptorSetsFile(std::vector<GlobalDescriptorSet> &globalConfigs,
+                                      const DescriptorSetArena &arena,
+                                      const std::string& filename, uint32_t framesInFlight) {
+    std::ostringstream outFile; // Only replaces the file on disk if the contents changed, see WriteFileIfChanged
 
     std::string boilerInputFilename = "IN_InputData.h";
     std::string boilerDescSetFilename = "IN_DescSetLayoutHeader.h";
+    outFile << "#pragma once\n";
     outFile << "#include <vulkan/vulkan.h>\n";
     outFile << "#include <array>\n\n";
     outFile << "#include \"" << boilerInputFilename << "\"\n";
     outFile << "#include \"" << boilerDescSetFilename << "\"\n\n";
 
 
-    // TODO: makes the grave assumption that structs with identical names will have identical members, this isn't necessarily true AND can be checked in future
+    // Structs are deduplicated by name AND layout, see StructRegistry
     outFile << "/********************************************************************************************\n";
     outFile << "****************************     " << "STRUCTS!!!!" << "     ******************************\n";
     outFile << "*********************************************************************************************/\n\n";
-    std::vector<std::string> declaredStructs;
-    for (auto [globalID, set] : reflectedGlobalDescSets) {
+    StructRegistry declaredStructs;
+    for (const auto& globalSet : globalConfigs) {
+        const SpvReflectDescriptorSet* set = globalSet.descSet;
         std::vector<SpvReflectDescriptorBinding*> bindings(set->bindings, set->bindings + set->binding_count);
         outFile << WriteUsedStructsInDescSet(bindings, declaredStructs) << "\n\n";
-        for (SpvReflectDescriptorBinding* binding : bindings) {
-            if (binding->descriptor_type == SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
-                declaredStructs.emplace_back(binding->type_description->type_name);
-        }
     }
 
-    std::vector<std::vector<SpvReflectDescriptorBinding*>> bindingsToSet_forDebug;
-    for (auto [globalID, set] : reflectedGlobalDescSets) {
-        auto it = std::find_if(globalConfigs.begin(), globalConfigs.end(),
-                   [globalID](const GlobalDescriptorSet& d) { return d.globalDescSetID == globalID; });
-        std::string setName = it->name;
+    // One set per global, the union of what every pipeline using it declares, seen by every stage that uses a binding
+    for (auto& globalSet : globalConfigs) {
+        const SpvReflectDescriptorSet* set = globalSet.descSet;
+        std::string setName = globalSet.name;
 
         outFile << "\n\n\n/********************************************************************************************\n";
         outFile << "****************************     " << setName << "     ******************************\n";
         outFile << "*********************************************************************************************/\n\n\n";
 
         std::vector<SpvReflectDescriptorBinding *> setBindings(set->bindings, set->bindings + set->binding_count);
-        outFile << WriteDescSetLayout(setBindings, setName) << "\n\n";
+        outFile << WriteDescSetLayout(setBindings, setName, &declaredStructs, arena.GetBindingFlags(set)) << "\n\n";
+
+        globalSet.managerName = globalSet.name + "_IMPL";
+        outFile << WriteDescSetTypedef(setName, arena.GetStageMaskList(set), globalSet.managerName,
+                                       GetLayoutFlagsAsString(arena.GetBindingFlags(set), set->binding_count));
+        outFile << WriteFramedDescSetTypedef(globalSet.managerName, framesInFlight);
+    }
+    WriteFileIfChanged(std::string(OUT_DIR) + filename, outFile.str());
+    return declaredStructs.GetEmittedNames();
+}
+
+bool MergePipelinePushConstants(const PipelineConfig &config, const ReflectionDatabase &database,
+                                MergedPushConstants &outMerged) {
+    std::vector<std::pair<uint32_t, const SpvReflectBlockVariable*>> stageBlocks;
+    for (const auto& stage : config.stages) {
+        SpvReflectShaderModule* module = database.GetModule(stage.filename);
+        uint32_t count = 0;
+        auto result = spvReflectEnumeratePushConstantBlocks(module, &count, NULL);
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+        std::vector<SpvReflectBlockVariable *> blocks(count);
+        result = spvReflectEnumeratePushConstantBlocks(module, &count, blocks.data());
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+        for (const SpvReflectBlockVariable* block : blocks)
+            stageBlocks.emplace_back(static_cast<uint32_t>(module->shader_stage), block);
+    }
+    return MergePushConstants(stageBlocks, outMerged);
+}
+
+std::unordered_set<std::string> GeneratePushConstantFile(const std::vector<PipelineConfig> &configs,
+                                                         const ReflectionDatabase &database, const std::string &filename) {
+    std::ostringstream outFile; // Only replaces the file on disk if the contents changed, see WriteFileIfChanged
+
+    std::string boilerInputFilename = "IN_InputData.h";
+    outFile << "#include <vulkan/vulkan.h>\n";
+    outFile << "#include <array>\n";
+    outFile << "#include \"" << boilerInputFilename << "\"\n\n";
 
-        it->managerName = it->name + "_IMPL";
-        outFile << "typedef " << setName << "_DescriptorSet<";
-        uint32_t numBindings = it->descSet->binding_count;
-        for (uint32_t i = 0; i < numBindings; ++i) {
-            outFile << "VK_SHADER_STAGE_ALL_GRAPHICS, ";
+    StructRegistry declaredStructs;
+    for (const auto& p : configs) {
+        MergedPushConstants merged;
+        if (!MergePipelinePushConstants(p, database, merged)) {
+            std::cerr << "ERROR: the stages of " << p.pipelineName << " declare conflicting push constants" << std::endl;
         }
-        outFile << "VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT> " << it->managerName << ";\n";
+        if (merged.members.empty()) continue;
+
+        outFile << "\n\n\n/********************************************************************************************\n";
+        outFile << "****************************     " << p.pipelineName << "     ******************************\n";
+        outFile << "*********************************************************************************************/\n\n\n";
+        outFile << WritePushConstants(merged, p.pipelineName, declaredStructs);
     }
-    return declaredStructs;
+
+    WriteFileIfChanged(std::string(OUT_DIR) + filename, outFile.str());
+    return declaredStructs.GetEmittedNames();
 }
 
 /**
  * Get and return the module for the pipeline that can take input variables.
  * Assumes this is always SPV_REFLECT_SHADER_STAGE_VERTEX_BIT.
  */
-SpvReflectShaderModule* GetInputModule(const PipelineConfig& config,
-                                       std::vector<std::pair<std::string, SpvReflectShaderModule *>> &modules) {
+SpvReflectShaderModule* GetInputModule(const PipelineConfig& config, const ReflectionDatabase &database) {
     auto it = std::find_if(config.stages.begin(), config.stages.end(),
                  [](const StageDescriptor& stage) { return stage.stageType == SPV_REFLECT_SHADER_STAGE_VERTEX_BIT; });
 
     if (it == config.stages.end()) return nullptr;
-    else return GetModule(modules, it->filename);
+    else return database.GetModule(it->filename);
 }
 
 void GenerateInputVariableFile(const std::vector<PipelineConfig> &configs,
-                               std::vector<std::pair<std::string, SpvReflectShaderModule *>> &modules,
+                               const ReflectionDatabase &database,
                                const std::string& filename) {
-    std::ofstream outFile(std::string(OUT_DIR) + filename);
-    if (!outFile.is_open()) {
-        std::cerr << "Failed to open the file." << std::endl;
-    }
+    std::ostringstream outFile; // Only replaces the file on disk if the contents changed, see WriteFileIfChanged
 
     std::string boilerInputFilename = "IN_InputData.h";
+    outFile << "#pragma once\n";
     outFile << "#include <vulkan/vulkan.h>\n";
     outFile << "#include <array>\n";
-    outFile << "#include \"" << boilerInputFilename << "\"\n\n";
+    outFile << "#include \"" << boilerInputFilename << "\"\n";
+    outFile << "#include \"IN_VertexPacking.h\"\n\n";
 
     for (const auto& p : configs) {
-        SpvReflectShaderModule* inModule = GetInputModule(p, modules);
+        SpvReflectShaderModule* inModule = GetInputModule(p, database);
         if (inModule) {
             uint32_t count;
             auto result = spvReflectEnumerateInputVariables(inModule, &count, NULL);
@@ -317,9 +508,11 @@ void GenerateInputVariableFile(const std::vector<PipelineConfig> &configs,
             result = spvReflectEnumerateInputVariables(inModule, &count, inputVars.data());
             assert(result == SPV_REFLECT_RESULT_SUCCESS);
 
-            // Structs will be called <p.pipelineName>Instance and <p.pipelineName>Vertex
-            auto vertInputs = WriteVertexInputs(inputVars, p.pipelineName);
-            auto instanceInputs = WriteInstanceInputs(inputVars, p.pipelineName);
+            // Structs will be called <p.pipelineName>Instance and <p.pipelineName>Vertex (plus one per vertex stream)
+            ValidateQuantizedInputs(inputVars, p.quantizedInputs, p.pipelineName);
+            auto vertInputs = WriteVertexInputs(inputVars, p.pipelineName, p.vertexStreams, p.quantizedInputs);
+            auto instanceInputs = WriteInstanceInputs(inputVars, p.pipelineName,
+                                                      CountVertexStreams(inputVars, p.vertexStreams), p.quantizedInputs);
 
             outFile << "\n\n\n/********************************************************************************************\n";
             outFile << "****************************     " << p.pipelineName << "     ******************************\n";
@@ -331,16 +524,191 @@ void GenerateInputVariableFile(const std::vector<PipelineConfig> &configs,
         }
     }
 
+    WriteFileIfChanged(std::string(OUT_DIR) + filename, outFile.str());
+}
 
+/** Everything the vertex input state of config is generated from, see GenerateInputVariableFile */
+uint64_t HashVertexInputs(const PipelineConfig& config, const std::vector<SpvReflectInterfaceVariable *>& inputVars) {
+    uint64_t hash = HashString("vertex inputs");
+    for (const auto* inVar : inputVars) {
+        hash = HashString(inVar->name ? inVar->name : "", hash);
+        hash = HashCombine(hash, inVar->location);
+        hash = HashCombine(hash, static_cast<uint64_t>(inVar->format));
+    }
+    for (const auto& stream : config.vertexStreams) {
+        hash = HashString(stream.name, hash);
+        for (const auto& name : stream.inputs) hash = HashString(name, hash);
+    }
+    for (const auto& [name, quantization] : config.quantizedInputs) {
+        hash = HashString(name, hash);
+        hash = HashCombine(hash, static_cast<uint64_t>(quantization));
+    }
+    return hash;
+}
+
+void GeneratePipelineFile(const std::vector<PipelineConfig>& configs, const std::vector<PipelineLayoutSignature>& signatures,
+                          const ReflectionDatabase& database, const std::vector<std::pair<std::string, uint64_t>>& stageHashes,
+                          const std::vector<std::string>& patchedShaderFiles, const std::string& filename) {
+    assert(configs.size() == signatures.size());
+    std::ostringstream outFile; // Only replaces the file on disk if the contents changed, see WriteFileIfChanged
+
+    outFile << "#pragma once\n";
+    outFile << "#include <vulkan/vulkan.h>\n";
+    outFile << "#include <array>\n";
+    outFile << "#include <tuple>\n";
+    outFile << "#include \"InputData.h\"\n";
+    outFile << "#include \"GlobalDescSetLayoutData.h\"\n";
+    outFile << "#include \"MaterialDescSetLayoutData.h\"\n\n";
+
+    std::unordered_map<std::string, uint64_t> stageHashByFilename(stageHashes.begin(), stageHashes.end());
+    std::vector<std::string> pipelineNames;
+    for (uint32_t p = 0; p < configs.size(); ++p) {
+        const PipelineConfig& config = configs[p];
+        const PipelineLayoutSignature& signature = signatures[p];
+        std::string pipelineName = config.pipelineName + "_Pipeline";
+        pipelineNames.push_back(pipelineName);
+
+        std::vector<SpvReflectInterfaceVariable *> inputVars;
+        if (SpvReflectShaderModule* inModule = GetInputModule(config, database)) {
+            uint32_t count;
+            auto result = spvReflectEnumerateInputVariables(inModule, &count, NULL);
+            assert(result == SPV_REFLECT_RESULT_SUCCESS);
+            inputVars.resize(count);
+            result = spvReflectEnumerateInputVariables(inModule, &count, inputVars.data());
+            assert(result == SPV_REFLECT_RESULT_SUCCESS);
+        }
+        std::vector<std::string> streamNames = GetVertexInputStreamNames(inputVars, config.pipelineName, config.vertexStreams);
+        MergedPushConstants pushConstants;
+        MergePipelinePushConstants(config, database, pushConstants);
+        bool isCompute = std::any_of(config.stages.begin(), config.stages.end(), [](const StageDescriptor& stage) {
+            return stage.stageType == SPV_REFLECT_SHADER_STAGE_COMPUTE_BIT;
+        });
+
+        // Stable across runs and machines: only the final layouts, the vertex input state and the stage code go in
+        uint64_t hash = HashString(config.pipelineName);
+        for (uint32_t s = 0; s < signature.GetSetCount(); ++s)
+            hash = HashString(signature.sets[s] ? signature.setKeys[s] : "-", hash);
+        hash = HashString(signature.pushConstantKey, hash);
+        hash = HashCombine(hash, HashVertexInputs(config, inputVars));
+        for (const auto& stage : config.stages) {
+            hash = HashString(stage.filename, hash);
+            auto stageHash = stageHashByFilename.find(stage.filename);
+            hash = HashCombine(hash, stageHash == stageHashByFilename.end() ? 0 : stageHash->second);
+        }
+
+        outFile << "\n\n\n/********************************************************************************************\n";
+        outFile << "****************************     " << config.pipelineName << "     ******************************\n";
+        outFile << "*********************************************************************************************/\n\n\n";
+        outFile << "struct " << pipelineName << " {\n";
+        outFile << "\tstatic constexpr const char* Name = \"" << config.pipelineName << "\";\n";
+        outFile << "\tstatic constexpr uint64_t Hash = 0x" << std::hex << hash << std::dec << "ull;\n";
+        outFile << "\tstatic constexpr VkPipelineBindPoint BindPoint = "
+                << (isCompute ? "VK_PIPELINE_BIND_POINT_COMPUTE" : "VK_PIPELINE_BIND_POINT_GRAPHICS") << ";\n\n";
+
+        // Sets 0..n-1 in order, the unused ones below the highest get an empty layout so the numbers still match
+        outFile << "\ttypedef std::tuple<";
+        for (uint32_t s = 0; s < signature.GetSetCount(); ++s) {
+            outFile << (s ? ", " : "") << (signature.sets[s] ? config.descSetManagerNames[s] : "EmptyDescriptorSet");
+        }
+        outFile << "> SetLayouts;\n";
+        outFile << "\tstatic constexpr std::array<VkPushConstantRange, " << pushConstants.ranges.size() << "> PushConstantRanges {\n";
+        for (const auto& range : pushConstants.ranges) {
+            outFile << "\t\tVkPushConstantRange { " << GetStageFlagsAsString(range.stageMask) << ", " << range.offset
+                    << ", " << range.size << " },\n";
+        }
+        outFile << "\t};\n\n";
+
+        outFile << "\tstatic constexpr std::array<VkVertexInputBindingDescription, " << streamNames.size() << "> VertexBindings {\n";
+        for (const auto& streamName : streamNames) outFile << "\t\t" << streamName << "InputBinding,\n";
+        outFile << "\t};\n";
+        if (streamNames.empty()) {
+            outFile << "\tstatic constexpr std::array<VkVertexInputAttributeDescription, 0> VertexAttributes{};\n\n";
+        } else {
+            outFile << "\tstatic constexpr auto VertexAttributes = ConcatArrays(";
+            for (size_t i = 0; i < streamNames.size(); ++i) outFile << (i ? ", " : "") << streamNames[i] << "VertAttribs";
+            outFile << ");\n\n";
+        }
+
+        outFile << "\tstatic constexpr std::array<PipelineStage, " << config.stages.size() << "> Stages {\n";
+        for (const auto& stage : config.stages) {
+            bool isPatched = std::find(patchedShaderFiles.begin(), patchedShaderFiles.end(), stage.filename) != patchedShaderFiles.end();
+            outFile << "\t\tPipelineStage { " << GetStageFlagsAsString(stage.stageType) << ", \"" << stage.filename
+                    << "\", " << (isPatched ? "true" : "false") << " },\n";
+        }
+        outFile << "\t};\n";
+        outFile << "};\n";
+    }
+
+    outFile << "\n\n/* Every pipeline, for WarmUpPipelines to create in parallel at load time */\n";
+    outFile << "inline constexpr std::array<PipelineManifestEntry, " << pipelineNames.size()
+            << "> PipelineManifest = MakePipelineManifest<";
+    for (size_t i = 0; i < pipelineNames.size(); ++i) outFile << (i ? ", " : "") << pipelineNames[i];
+    outFile << ">();\n";
+
+    WriteFileIfChanged(std::string(OUT_DIR) + filename, outFile.str());
+}
+
+/**
+ * Supported flags:
+ *      -j <N>, --jobs <N>      number of threads used for reflection, 0 (default) uses all hardware threads
+ *      --no-cache              always regenerate, even if nothing changed since the last run
+ *      --depfile <path>        where to write the Make/Ninja depfile, defaults to OUT_DIR/ShaderGen.d
+ *      --dead-bindings <mode>  keep (default), drop or partial: what to do with bindings no stage statically uses
+ *      --compact-bindings      renumber bindings densely, writing patched stage files to OUT_DIR/PatchedShaders/
+ *      --patched-shader-dir <path>  where the patched stage files go instead, relative to OUT_DIR
+ *      --bindless <N>          arrays of at least N descriptors (and unsized ones) become bindless, update after bind
+ *      --bindless-count <N>    descriptors of every bindless runtime array, 4096 by default
+ *      --frames-in-flight <N>  copies of every set in its _Framed typedef, 2 by default
+ *      --draw-order <a,b,...>  pipeline names in the order a frame draws them, for the pipeline layout report
+ */
+ShaderGenOptions ParseShaderGenOptions(int argn, char** argv) {
+    ShaderGenOptions options{};
+    for (int i = 1; i < argn; ++i) {
+        std::string arg(argv[i]);
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < argn) {
+            options.workerCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) {
+            options.workerCount = static_cast<uint32_t>(std::stoul(arg.substr(2)));
+        } else if (arg == "--no-cache") {
+            options.useCache = false;
+        } else if (arg == "--depfile" && i + 1 < argn) {
+            options.depfilePath = argv[++i];
+        } else if (arg == "--compact-bindings") {
+            options.compactBindings = true;
+        } else if (arg == "--patched-shader-dir" && i + 1 < argn) {
+            options.patchedShaderDir = argv[++i];
+            if (!options.patchedShaderDir.empty() && options.patchedShaderDir.back() != '/') options.patchedShaderDir += '/';
+        } else if (arg == "--bindless" && i + 1 < argn) {
+            options.bindlessMinArraySize = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--bindless-count" && i + 1 < argn) {
+            options.bindlessDescriptorCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--draw-order" && i + 1 < argn) {
+            std::istringstream names(argv[++i]);
+            for (std::string name; std::getline(names, name, ',');)
+                if (!name.empty()) options.drawOrder.push_back(name);
+        } else if (arg == "--frames-in-flight" && i + 1 < argn) {
+            options.framesInFlight = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--dead-bindings" && i + 1 < argn) {
+            std::string mode(argv[++i]);
+            if (mode == "keep") options.deadBindings = DeadBindingMode::KEEP;
+            else if (mode == "drop") options.deadBindings = DeadBindingMode::DROP;
+            else if (mode == "partial") options.deadBindings = DeadBindingMode::PARTIALLY_BOUND;
+            else std::cerr << "WARNING: unknown --dead-bindings mode '" << mode << "', keeping all bindings" << std::endl;
+        } else {
+            std::cerr << "WARNING: ignoring unknown argument '" << arg << "'" << std::endl;
+        }
+    }
+    return options;
 }
 
 // =================================================================================================
 // main()
 // =================================================================================================
 int main(int argn, char** argv) {
+    ShaderGenOptions options = ParseShaderGenOptions(argn, argv);
     ExampleParseSingleModule();
     std::cout << "done" << std::endl;
-    GlobalDescriptorSet globalDescSet1 { .name = "AJohnnyTime", .globalDescSetID = 0, };
+    GlobalDescriptorSet globalDescSet1 { .name = "AJohnnyTime", .globalDescSetID = 0, .dynamicUniforms = { "CameraView" } };
     GlobalDescriptorSet globalDescSet2 { .name = "AJillyTime", .globalDescSetID = 1, };
 
     PipelineConfig pipelineConfig1{.globalDescSetID = 0, .pipelineName = "RedDead1", .stages = {
@@ -349,9 +717,11 @@ int main(int argn, char** argv) {
     };
     PipelineConfig pipelineConfig2 { .globalDescSetID = 1, .pipelineName = "RedDead2", .stages = {
             StageDescriptor{std::string("test_shader_split_vert.spv"), SPV_REFLECT_SHADER_STAGE_VERTEX_BIT},
-            StageDescriptor{std::string("test_shader_split_frag.spv"), SPV_REFLECT_SHADER_STAGE_FRAGMENT_BIT}, }
+            StageDescriptor{std::string("test_shader_split_frag.spv"), SPV_REFLECT_SHADER_STAGE_FRAGMENT_BIT}, },
+            .vertexStreams = { VertexStreamConfig{ "Position", { "inPos" } } },
+            .quantizedInputs = { { "inUV", AttributeQuantization::HALF } }
     };
-    PerformShaderGen({globalDescSet1, globalDescSet2}, { pipelineConfig2, pipelineConfig1 });
+    PerformShaderGen({globalDescSet1, globalDescSet2}, { pipelineConfig2, pipelineConfig1 }, options);
     return 0;
 }
 
@@ -376,50 +746,31 @@ int main(int argn, char** argv) {
 
 
 
-
-SpvReflectDescriptorSet *GetDescSetOf(uint32_t id, SpvReflectShaderModule *module) {
-    uint32_t count = 0;
-    auto result = spvReflectEnumerateDescriptorSets(module, &count, NULL);
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-    std::vector<SpvReflectDescriptorSet *> sets(count);
-    result = spvReflectEnumerateDescriptorSets(module, &count, sets.data());
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-    auto it = std::find_if(sets.begin(), sets.end(),
-                           [id](auto set) { return set->set == id; });
-    if (it != sets.end()) return *it;
-    else return nullptr;
-}
 
 std::vector<std::array<SpvReflectDescriptorSet *, MAX_DESCRIPTOR_SETS>>
 MergeModulesUnionDescriptorSetsByPipeline(const std::vector<PipelineConfig> &pipelines,
-                                          const std::vector<std::pair<std::string, SpvReflectShaderModule *>> &modules) {
+                                          const ReflectionDatabase &database, DescriptorSetArena &arena) {
     std::vector<std::array<SpvReflectDescriptorSet *, MAX_DESCRIPTOR_SETS>> output;
+    output.reserve(pipelines.size());
+    DescriptorSetUnion unionSet; // Scratch, reused for every set of every pipeline
     // For each pipeline
     for (const auto& p : pipelines) {
-        std::vector<SpvReflectShaderModule *> pModules(p.stages.size());
-        std::transform(p.stages.begin(), p.stages.end(), pModules.begin(),[modules] (auto& desc)
-        { return GetModule(modules, desc.filename); });
         output.emplace_back();
         // For each descriptor set index, merge all the declarations between stages
         for (uint32_t i = 0; i < MAX_DESCRIPTOR_SETS; ++i) {
-            output.back()[i] = nullptr;
-            std::vector<SpvReflectDescriptorSet*> descSetsPerStage(p.stages.size());
-            std::transform(pModules.begin(), pModules.end(), descSetsPerStage.begin(),[i] (auto mod)
-            { return GetDescSetOf(i, mod); });
-
-            // NOTE: we do this weird little thing to preserve the possibility of a null set, and to keep the functional expectation of a Union-Alloced set (meaning set and bindings allocated)
-            for (auto set : descSetsPerStage) {
+            unionSet.Reset(i);
+            bool anyStageDeclares = false; // An empty set declared by some stage is still a set
+            for (const auto& stage : p.stages) {
+                SpvReflectShaderModule* module = database.GetModule(stage.filename);
+                SpvReflectDescriptorSet* set = database.GetDescSet(module, i);
                 if (set == nullptr) continue;
-                if (output.back()[i] == nullptr) {
-                    output.back()[i] = new SpvReflectDescriptorSet{ set->set, set->binding_count, new SpvReflectDescriptorBinding *[set->binding_count] };
-                    for (size_t b = 0; b < set->binding_count; b++) output.back()[i]->bindings[b] = set->bindings[b];
-                } else {
-                    auto* unionedDestSet = Union(output.back()[i], set);
-                    FreeUnionDescSet(output.back()[i]);
-                    output.back()[i] = unionedDestSet;
+                anyStageDeclares = true;
+                if (!unionSet.Add(set, static_cast<uint32_t>(module->shader_stage))) {
+                    std::cerr << "ERROR: " << stage.filename << " declares set " << i << " differently from the other stages of "
+                              << p.pipelineName << ", ignoring its declaration" << std::endl;
                 }
             }
+            output.back()[i] = anyStageDeclares ? unionSet.Build(arena) : nullptr;
         }
     }
     return output;
@@ -431,77 +782,66 @@ MergeModulesUnionDescriptorSetsByPipeline(const std::vector<PipelineConfig> &pip
  * @param INOUT_globalDescSets
  */
 void PopulateGlobalDescriptorLayouts(const std::vector<std::pair<uint32_t, SpvReflectDescriptorSet*>> &pipelineDescSetsAtGlobal,
-                                     std::vector<GlobalDescriptorSet>& INOUT_globalDescSets) {
+                                     std::vector<GlobalDescriptorSet>& INOUT_globalDescSets, DescriptorSetArena &arena) {
     auto configs = pipelineDescSetsAtGlobal;
-    std::sort(configs.begin(), configs.end(), [](const auto& a, const auto& b)
+    // Stable, so the first pipeline to declare a binding keeps providing it
+    std::stable_sort(configs.begin(), configs.end(), [](const auto& a, const auto& b)
     { return a.first < b.first; });
+    DescriptorSetUnion unionSet;
     for (auto& inout_descSet : INOUT_globalDescSets) {
         uint32_t id = inout_descSet.globalDescSetID;
-        inout_descSet.descSet = new SpvReflectDescriptorSet{ 0, 0, nullptr};
+        unionSet.Reset(GLOBAL_DESCSET_INDEX);
         auto itr = std::find_if(configs.begin(), configs.end(),
                                 [id](const auto& p) { return p.first == id; });
         while (itr != configs.end() && itr->first == id) {
-            SpvReflectDescriptorSet* unionedSet = Union(inout_descSet.descSet, itr->second);
-            FreeUnionDescSet(inout_descSet.descSet);
-            inout_descSet.descSet = unionedSet;
+            // The pipelines' stage masks are or'ed together, a binding is visible to every stage of any pipeline using it
+            if (itr->second && !unionSet.Add(itr->second, arena)) {
+                std::cerr << "ERROR: pipelines sharing global descriptor set " << inout_descSet.name
+                          << " declare it differently, ignoring one of the declarations" << std::endl;
+            }
             itr = std::next(itr);
         }
+        inout_descSet.descSet = unionSet.Build(arena);
     }
 }
 
 
 
-std::vector<std::pair<std::string, SpvReflectShaderModule *>>
-CreateAllReflectModules(const std::vector<PipelineConfig> &pipelines) {
-    std::vector<std::pair<std::string, SpvReflectShaderModule *>> modules;
+void CreateAllReflectModules(const std::vector<PipelineConfig> &pipelines, ReflectionDatabase& INOUT_database,
+                             uint32_t workerCount) {
+    // Gather the unique files first, in order of first reference, so the output never depends on scheduling
+    std::vector<std::string> filenames;
+    std::unordered_set<std::string> seenFiles;
     for (const auto& p : pipelines) {
         for (const auto& descSet : p.stages) {
-            if (GetModule(modules, descSet.filename) == nullptr) {
-                modules.emplace_back(descSet.filename, MakeShaderModule(descSet.filename));
+            if (seenFiles.insert(descSet.filename).second) {
+                filenames.push_back(descSet.filename);
             }
         }
     }
-    return modules;
+
+    std::vector<SpvReflectShaderModule*> modules(filenames.size());
+    std::vector<SpirvFileMapping> moduleCode(filenames.size());
+    ParallelForEachIndex(filenames.size(), workerCount, [&](size_t i) {
+        modules[i] = MakeShaderModule(filenames[i], moduleCode[i]);
+    });
+    for (size_t i = 0; i < filenames.size(); ++i)
+        INOUT_database.AddModule(filenames[i], modules[i], std::move(moduleCode[i]));
 }
 
-SpvReflectShaderModule *MakeShaderModule(const std::string &filename) {
+SpvReflectShaderModule *MakeShaderModule(const std::string &filename, SpirvFileMapping& INOUT_code) {
     std::string input_spv_path = SHADER_DIR + filename;
 
-    std::ifstream spv_ifstream(input_spv_path.c_str(), std::ios::binary);
-    if (!spv_ifstream.is_open()) {
+    INOUT_code = SpirvFileMapping(input_spv_path);
+    if (!INOUT_code.IsValid()) {
         std::cerr << "ERROR: could not open '" << input_spv_path << "' for reading\n";
         abort();
     }
 
-    spv_ifstream.seekg(0, std::ios::end);
-    size_t size = static_cast<size_t>(spv_ifstream.tellg());
-    spv_ifstream.seekg(0, std::ios::beg);
-
-    std::vector<char> spv_data(size);
-    spv_ifstream.read(spv_data.data(), size);
-    spv_ifstream.close();
-
+    // NO_COPY: reflection reads the mapped words in place instead of duplicating the whole module
     SpvReflectShaderModule* module = new SpvReflectShaderModule{};
-    SpvReflectResult result = spvReflectCreateShaderModule(spv_data.size(), spv_data.data(), module);
+    SpvReflectResult result = spvReflectCreateShaderModule2(SPV_REFLECT_MODULE_FLAG_NO_COPY,
+                                                            INOUT_code.ByteSize(), INOUT_code.Words(), module);
     assert(result == SPV_REFLECT_RESULT_SUCCESS);
     return module;
 }
-
-SpvReflectShaderModule *
-GetModule(const std::vector<std::pair<std::string, SpvReflectShaderModule *>> &modules, const std::string &key) {
-    auto it = std::find_if(modules.begin(), modules.end(),
-                           [key](auto e) { return e.first == key; });
-    if (it != modules.end()) return it->second;
-    return nullptr;
-}
-
-void FreeReflectModules(std::vector<std::pair<std::string, SpvReflectShaderModule *>> &modules) {
-    for (auto& [fn, module] : modules) {
-        spvReflectDestroyShaderModule(module);
-        delete module;
-    }
-}
-
-
-void reflectPushConstants(const std::vector<SpvReflectBlockVariable*>& pushConstants) {
-}
\ No newline at end of file
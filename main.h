@@ -12,118 +12,636 @@
 #include <bitset>
 #include <sstream>
 #include <memory>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
 #include "main.h"
 
 #include "SPIRV-Reflect/spirv_reflect.h"
 
 #define GLOBAL_DESCSET_INDEX 0
 #define MAX_DESCRIPTOR_SETS 4
+#define MAX_SET_BINDINGS 256 // Binding numbers the union engine holds before it has to grow
 
 struct StageDescriptor {
     std::string filename;
     SpvReflectShaderStageFlagBits stageType;
 };
 
+/** One vertex buffer binding holding some of a pipeline's per-vertex inputs, interleaved */
+struct VertexStreamConfig {
+    std::string name; // The stream's struct is <pipelineName><name>Vertex
+    std::vector<std::string> inputs; // Names of the vertex stage inputs read from this stream
+};
+
+/** Format a vertex input is stored in, the shader still reads floats, the vertex fetch converts them */
+enum class AttributeQuantization {
+    NONE,    // The shader's own 32 bit float format
+    HALF,    // 16 bit floats, i.e. UVs
+    SNORM16, // [-1, 1] in 16 bits
+    UNORM16, // [0, 1] in 16 bits
+    SNORM8,  // [-1, 1] in 8 bits, i.e. normals and tangents
+    UNORM8,  // [0, 1] in 8 bits, i.e. colors
+};
+typedef std::vector<std::pair<std::string, AttributeQuantization>> AttributeQuantizations; // <input name, format>
+
 // TODO: make a config param that lets the user name the descriptors
 struct PipelineConfig {
     uint32_t globalDescSetID;
     std::string pipelineName;
     std::vector<StageDescriptor> stages;
     std::vector<std::string> layoutFlags; // i.e. "VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT"
+    /**
+     * Splits the per-vertex inputs over several vertex buffers, bound 0..n-1 in this order, the inputs no stream lists
+     * follow in <pipelineName>Vertex. Empty interleaves every input in <pipelineName>Vertex.
+     * i.e. {{"Position", {"inPosition"}}} so depth and shadow passes only fetch positions
+     */
+    std::vector<VertexStreamConfig> vertexStreams;
+    /** Uniform buffers of the pipeline's own sets to bind with dynamic offsets, by instance or block name, see MakeDynamicUniforms */
+    std::vector<std::string> dynamicUniforms;
+    /**
+     * Float inputs stored quantized instead of at full precision, 3 component ones are padded to 4 components.
+     * Their streams get a <struct>Source of full-precision arrays and a Pack<struct> that converts them with SIMD.
+     */
+    AttributeQuantizations quantizedInputs;
     /**
      * Not for user
      */
     std::array<std::string, MAX_DESCRIPTOR_SETS> descSetManagerNames;
 };
 
+/**
+ * What to do with bindings that are declared but never statically used by any stage that sees them.
+ * Vulkan only requires statically used bindings to be in the layout, so they can be left out entirely.
+ */
+enum class DeadBindingMode {
+    KEEP,            // Every declared binding stays in the layout
+    DROP,            // Dead bindings are removed from the layout
+    PARTIALLY_BOUND, // Dead bindings stay, flagged PARTIALLY_BOUND so they never need a descriptor written
+};
+
+/**
+ * Knobs for a whole generator run, as opposed to per-pipeline configuration.
+ */
+struct ShaderGenOptions {
+    uint32_t workerCount = 0; // Threads used to reflect modules, 0 uses all hardware threads
+    bool useCache = true; // Skip the whole run when no input or output changed since the last one
+    std::string cacheFilename = ".ShaderGenCache"; // Relative to OUT_DIR
+    std::string depfilePath; // Empty writes OUT_DIR/ShaderGen.d
+    DeadBindingMode deadBindings = DeadBindingMode::KEEP;
+    bool compactBindings = false; // Renumber every merged set to 0..n-1, see CompactBindings
+    std::string patchedShaderDir = "PatchedShaders/"; // Relative to OUT_DIR, only renumbered stage files are written
+    uint32_t bindlessMinArraySize = 0; // Arrays at least this long become bindless, 0 disables, see MakeBindlessBindings
+    uint32_t bindlessDescriptorCount = 4096; // Descriptors of every bindless runtime array
+    uint32_t framesInFlight = 2; // Copies of every set in its _Framed typedef, see FramedDescriptorSet
+    std::vector<std::string> drawOrder; // Pipeline names, as drawn in a frame, for the layout report. Empty uses config order
+};
+
 struct GlobalDescriptorSet {
     std::string name;
     uint32_t globalDescSetID;
     SpvReflectDescriptorSet* descSet;
+    std::vector<std::string> dynamicUniforms; // i.e. {"CameraView"}, see PipelineConfig::dynamicUniforms
     /**
      * Not for user
      */
     std::string managerName;
 };
 
+/**
+ * Canonical table of the buffer block structs emitted into one generated file. Structs are keyed by name and by a deep
+ * structural hash of their layout (see HashStructLayout), confirmed with EqualsStructLayout, so each is emitted once,
+ * and a name reused for a different layout is reported and emitted under a disambiguated name instead of silently
+ * aliasing the first one.
+ */
+class StructRegistry {
+public:
+    /**
+     * @param outIsNew true if the struct still has to be emitted into the file
+     * @return The name the binding's struct is emitted under
+     */
+    const std::string& Register(const SpvReflectDescriptorBinding* binding, bool& outIsNew);
+    /** Same, for any (possibly nested) struct laid out by layout */
+    const std::string& Register(const std::string& typeName, const SpvReflectBlockVariable& layout, bool& outIsNew);
+    /** Name of a registered binding's struct, or its reflected type name if it was never registered */
+    std::string GetName(const SpvReflectDescriptorBinding* binding) const;
+    const std::unordered_set<std::string>& GetEmittedNames() const { return m_emittedNames; }
+private:
+    struct RegisteredStruct {
+        std::string typeName;
+        SpvReflectBlockVariable layout; // Shallow copy, its members still point into the reflected modules
+        std::string emittedName;
+    };
+    std::deque<RegisteredStruct> m_structs; // A deque, so the returned names stay put
+    std::unordered_set<std::string> m_typeNames; // Reflected names seen so far
+    std::unordered_multimap<uint64_t, size_t> m_structsByKey; // Hash of (reflected name, layout) -> m_structs index
+    std::unordered_map<const SpvReflectBlockVariable*, size_t> m_structByBlock;
+    std::unordered_set<std::string> m_emittedNames;
+};
+
 // BASELINE BOILERPLATE
 std::string WriteFromFile(const std::string& inFilename);
 std::string WriteTypeDescriptionsBoilerplate();
 std::string WriteDescSetLayoutBoilerplate();
 
+// OUTPUT FILES
+/**
+ * Replaces the file with contents through a temporary file and a rename, but only if its contents differ,
+ * so unchanged outputs keep their timestamps and never trigger downstream rebuilds.
+ * @return true if the file was written
+ */
+bool WriteFileIfChanged(const std::string& path, const std::string& contents);
+/**
+ * Make/Ninja style depfile, one "target: deps..." rule per entry
+ */
+std::string WriteDepfile(const std::vector<std::pair<std::string, std::vector<std::string>>>& targetsToDeps);
+
 // WRITE AND PARSING INDIVIDUAL MODULES
 void reflectInputVariables(const std::vector<SpvReflectInterfaceVariable *>& inputVars);
-void reflectDescriptorSets(const std::string& pipelineName, const std::vector<SpvReflectDescriptorSet*>& sets);
+void reflectDescriptorSets(const std::string& pipelineName, const std::vector<SpvReflectDescriptorSet*>& sets, uint32_t stageMask);
+void reflectPushConstants(const std::vector<SpvReflectBlockVariable*>& pushConstants, uint32_t stageMask);
 
 std::string GetTypeAsString(SpvReflectInterfaceVariable* inVar);
 std::string GetTypeAsString(SpvReflectTypeDescription* typeDesc);
 std::string GetFormatAsString(SpvReflectFormat format);
 std::string GetDescriptorTypeAsString(SpvReflectDescriptorType descType);
+/** VkDescriptorImageInfo, VkDescriptorBufferInfo or VkBufferView, "" for types written through a pNext chain */
+std::string GetDescriptorInfoTypeAsString(SpvReflectDescriptorType descType);
+/** Same bits as VkDescriptorBindingFlagBits, the generator itself doesn't depend on the Vulkan headers */
+enum DescriptorBindingFlagBits : uint32_t {
+    BINDING_FLAG_UPDATE_AFTER_BIND = 0x1,
+    BINDING_FLAG_UPDATE_UNUSED_WHILE_PENDING = 0x2,
+    BINDING_FLAG_PARTIALLY_BOUND = 0x4,
+    BINDING_FLAG_VARIABLE_DESCRIPTOR_COUNT = 0x8,
+};
+/** VkDescriptorBindingFlagBits expression for a DescriptorBindingFlagBits mask, "0" if empty */
+std::string GetBindingFlagsAsString(uint32_t bindingFlags);
+/** VkShaderStageFlagBits expression for a SpvReflectShaderStageFlagBits mask (the bits are the same), e.g. "A | B" */
+std::string GetStageFlagsAsString(uint32_t stageMask);
 
-std::string WriteVertexInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars, const std::string &postfix="");
-std::string WriteInstanceInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars, const std::string &postfix="");
+/** Per-vertex inputs as split by streams, see PipelineConfig::vertexStreams and PipelineConfig::quantizedInputs */
+std::string WriteVertexInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars, const std::string &postfix="",
+                              const std::vector<VertexStreamConfig> &streams = {},
+                              const AttributeQuantizations &quantizedInputs = {});
+/** Vertex buffer bindings WriteVertexInputs uses, the instance inputs are bound right after them */
+uint32_t CountVertexStreams(const std::vector<SpvReflectInterfaceVariable *> &inputVars,
+                            const std::vector<VertexStreamConfig> &streams);
+/**
+ * Structs of the streams WriteVertexInputs and WriteInstanceInputs write that read any input, in binding order, i.e.
+ * {"FooPositionVertex", "FooVertex", "FooInstance"}
+ */
+std::vector<std::string> GetVertexInputStreamNames(const std::vector<SpvReflectInterfaceVariable *> &inputVars,
+                                                   const std::string &postfix,
+                                                   const std::vector<VertexStreamConfig> &streams = {});
+/** Inputs whose name ends in _i, read once per instance */
+std::string WriteInstanceInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars, const std::string &postfix="",
+                                uint32_t binding = 1, const AttributeQuantizations &quantizedInputs = {});
+/** Reports the quantized inputs that aren't float inputs of inputVars, those keep their full precision format */
+bool ValidateQuantizedInputs(const std::vector<SpvReflectInterfaceVariable *> &inputVars,
+                             const AttributeQuantizations &quantizedInputs, const std::string &pipelineName);
+/** VkFormat of a float input with componentCount components stored as quantization */
+std::string GetQuantizedFormatAsString(AttributeQuantization quantization, uint32_t componentCount);
 
 std::string
-WriteUsedStructsInDescSet(const std::vector<SpvReflectDescriptorBinding *> &bindings, const std::vector<std::string> &prohibitedStructs={});
-std::string WriteDescSetLayout(const std::vector<SpvReflectDescriptorBinding*>& bindings, const std::string& setName= "DEFAULT_NAME");
+WriteUsedStructsInDescSet(const std::vector<SpvReflectDescriptorBinding *> &bindings, StructRegistry &INOUT_structs);
+/**
+ * Struct whose members sit exactly at the block's reflected (std140/std430) offsets, with explicit padding, strided
+ * array and matrix wrappers where needed, and static_asserts pinning every offset and the total size.
+ * Nested struct types are written first, through INOUT_structs so each is only written once.
+ * @param sizeOverride 0 for the block's own padded size
+ */
+std::string WriteBlockStruct(const SpvReflectBlockVariable& block, const std::string& structName, uint32_t alignment,
+                             StructRegistry& INOUT_structs, uint32_t sizeOverride = 0);
+/**
+ * The push constant blocks of all stages of a pipeline as one block. Members keep their absolute offsets (push constant
+ * space is shared between stages), and each stage's range covers its own members only.
+ */
+struct MergedPushConstants {
+    struct StageRange {
+        uint32_t stageMask; // SpvReflectShaderStageFlagBits of every stage using exactly this range
+        uint32_t offset;
+        uint32_t size;
+    };
+    std::vector<SpvReflectBlockVariable> members; // Copies sorted by offset, their type data still points into modules
+    std::vector<StageRange> ranges;
+    uint32_t size = 0; // End of the last member, a multiple of 4
+};
+/**
+ * @param stageBlocks <stage, that stage's push constant block>
+ * @return false if two stages declare overlapping members differently, the first declaration is kept
+ */
+bool MergePushConstants(const std::vector<std::pair<uint32_t, const SpvReflectBlockVariable*>>& stageBlocks,
+                        MergedPushConstants& outMerged);
+/**
+ * <name>_PushConstants, the layout exact struct of the whole block, and <name>_PushConstantLayout with the
+ * VkPushConstantRange array for the pipeline layout and a Push helper for command buffers.
+ */
+std::string WritePushConstants(const MergedPushConstants& merged, const std::string& name, StructRegistry& INOUT_structs);
+/** @param bindingFlags DescriptorBindingFlagBits per binding, parallel to bindings, nullptr for none */
+std::string WriteDescSetLayout(const std::vector<SpvReflectDescriptorBinding*>& bindings, const std::string& setName= "DEFAULT_NAME",
+                               const StructRegistry* structs = nullptr, const uint32_t* bindingFlags = nullptr);
+/**
+ * typedef of a set class written by WriteDescSetLayout, with the stages that see each binding as template arguments
+ * @param layoutFlags VkDescriptorSetLayoutCreateFlags expression, see GetLayoutFlagsAsString
+ */
+std::string WriteDescSetTypedef(const std::string& setName, const std::vector<uint32_t>& bindingStageMasks,
+                                const std::string& typedefName, const std::string& layoutFlags = "0");
+/** typedef of the frames in flight wrapper of typedefName (a WriteDescSetTypedef), i.e. FOO_MAT_IMPL -> FOO_MAT_Framed */
+std::string WriteFramedDescSetTypedef(const std::string& typedefName, uint32_t framesInFlight);
+/**
+ * The user's layout flags, plus UPDATE_AFTER_BIND_POOL if any of the bindingCount bindingFlags is UPDATE_AFTER_BIND
+ * (Vulkan requires it then, and forbids allocating from a regular pool otherwise). "0" if empty.
+ */
+std::string GetLayoutFlagsAsString(const uint32_t* bindingFlags, uint32_t bindingCount,
+                                   const std::vector<std::string>& userLayoutFlags = {});
 std::string WriteDescSetLayoutManager(const std::vector<std::pair<uint32_t, std::string>>& regDescSets,
-                                      const std::vector<SpvReflectDescriptorSet *> &sets);
+                                      const std::vector<SpvReflectDescriptorSet *> &sets, uint32_t stageMask);
 
 // PIPELINES
+/** Uniform and storage buffers (dynamic or not), the descriptor types backed by a block struct */
+bool IsBufferBlock(SpvReflectDescriptorType descriptorType);
 bool Equals(SpvReflectTypeDescription* a, SpvReflectTypeDescription* b);
 bool Equals(SpvReflectImageTraits& a, SpvReflectImageTraits& b);
 bool Equals(SpvReflectDescriptorBinding* a, SpvReflectDescriptorBinding* b);
 bool Equals(SpvReflectDescriptorSet * a, SpvReflectDescriptorSet * b);
+/** Deep comparison of member names, offsets, sizes, type flags, numeric and array traits */
+bool Equals(const SpvReflectBlockVariable& a, const SpvReflectBlockVariable& b);
+/** The part of Equals(SpvReflectBlockVariable) HashStructLayout covers, the members only */
+bool EqualsStructLayout(const SpvReflectBlockVariable& a, const SpvReflectBlockVariable& b);
+/** Recursive hash over the same properties Equals(SpvReflectBlockVariable) compares, ignores the block's own name */
+uint64_t HashBlockLayout(const SpvReflectBlockVariable& block);
+/**
+ * Hash of the struct type of block: its members' names, offsets and HashBlockLayout. Not where block itself sits, so
+ * the same struct held as an array, a single member or a whole block hashes the same.
+ */
+uint64_t HashStructLayout(const SpvReflectBlockVariable& block);
+
+/**
+ * Owns every unioned descriptor set of a run (the set and its binding array), all released together when the arena
+ * is destroyed. Sets never move once made.
+ */
+class DescriptorSetArena {
+public:
+    SpvReflectDescriptorSet* MakeSet(uint32_t setID, uint32_t bindingCount);
+    /**
+     * Which shader stages see each binding of a set made here, parallel to set->bindings.
+     * SpvReflectShaderStageFlagBits, which share their bits with VkShaderStageFlagBits. nullptr for sets made elsewhere.
+     */
+    uint32_t* GetStageMasks(const SpvReflectDescriptorSet* set);
+    const uint32_t* GetStageMasks(const SpvReflectDescriptorSet* set) const;
+    /** Like GetStageMasks, but only the stages that statically use the binding (SpvReflectDescriptorBinding::accessed) */
+    uint32_t* GetAccessedStageMasks(const SpvReflectDescriptorSet* set);
+    const uint32_t* GetAccessedStageMasks(const SpvReflectDescriptorSet* set) const;
+    /** DescriptorBindingFlagBits of every binding of a set made here, parallel to set->bindings, all 0 when made */
+    uint32_t* GetBindingFlags(const SpvReflectDescriptorSet* set);
+    const uint32_t* GetBindingFlags(const SpvReflectDescriptorSet* set) const;
+    /** Copy of the stage masks of the set, ALL_GRAPHICS for sets made elsewhere */
+    std::vector<uint32_t> GetStageMaskList(const SpvReflectDescriptorSet* set) const;
+    /** Copy owned by the arena, to change a binding in one set without touching the module (and other sets) it came from */
+    SpvReflectDescriptorBinding* CopyBinding(const SpvReflectDescriptorBinding* binding);
+private:
+    static constexpr size_t BINDINGS_PER_BLOCK = 4096;
+    std::deque<SpvReflectDescriptorSet> m_sets;
+    std::deque<SpvReflectDescriptorBinding> m_bindingCopies;
+    struct BindingAnnotations {
+        uint32_t* stageMasks;
+        uint32_t* accessedStageMasks;
+        uint32_t* bindingFlags;
+    };
+    std::unordered_map<const SpvReflectDescriptorSet*, BindingAnnotations> m_annotationsBySet;
+    std::vector<std::unique_ptr<SpvReflectDescriptorBinding*[]>> m_bindingBlocks;
+    std::vector<std::unique_ptr<uint32_t[]>> m_annotationBlocks; // 3 masks per binding of the matching m_bindingBlocks
+    size_t m_blockUsed = 0;
+    size_t m_blockCapacity = 0;
+};
+
+/**
+ * Accumulates the union of descriptor sets in a dense array indexed by binding number.
+ * Checking and adding a set is linear in that set's binding count and only allocates to grow past
+ * MAX_SET_BINDINGS (or the highest binding seen since), Build copies the result out (into an arena).
+ */
+class DescriptorSetUnion {
+public:
+    explicit DescriptorSetUnion(uint32_t setID = 0) { Reset(setID); }
+    void Reset(uint32_t setID);
+    /** If false, other declares a binding of this union differently (or is a different set number) */
+    bool IsCompatible(const SpvReflectDescriptorSet* other) const;
+    /**
+     * Leaves the union untouched and returns false if other is not compatible.
+     * stageMask is or'ed into the stages of every binding other declares, even ones already in the union,
+     * and into the accessed stages of the ones other statically uses.
+     */
+    bool Add(const SpvReflectDescriptorSet* other, uint32_t stageMask = 0);
+    /** Same, with the per-binding masks of a set built in arena (sets made elsewhere add no stages) */
+    bool Add(const SpvReflectDescriptorSet* other, const DescriptorSetArena& arena);
+    bool IsEmpty() const { return m_bindingCount == 0; }
+    uint32_t GetSetID() const { return m_setID; }
+    /** Only the declared bindings, ordered by binding number, so the result has no holes */
+    SpvReflectDescriptorSet* Build(DescriptorSetArena& arena) const;
+private:
+    uint32_t m_setID = 0;
+    uint32_t m_endBinding = 0; // One past the highest occupied binding number
+    uint32_t m_bindingCount = 0; // Occupied bindings
+    std::vector<SpvReflectDescriptorBinding*> m_bindings; // nullptr where unoccupied
+    std::vector<uint32_t> m_stageMasks;
+    std::vector<uint32_t> m_accessedStageMasks;
+
+    bool Merge(const SpvReflectDescriptorSet* other, uint32_t stageMask, const uint32_t* stageMasks,
+               const uint32_t* accessedStageMasks);
+};
 
 bool CouldBeUnioned(SpvReflectDescriptorSet *a, SpvReflectDescriptorSet *b);
-SpvReflectDescriptorSet* Union(SpvReflectDescriptorSet* a, SpvReflectDescriptorSet* b);
+/** nullptr if the sets cannot be unioned */
+SpvReflectDescriptorSet* Union(SpvReflectDescriptorSet* a, SpvReflectDescriptorSet* b, DescriptorSetArena& arena);
 
 uint32_t CountMaxBinding(SpvReflectDescriptorSet* a);
-SpvReflectDescriptorBinding* GetBindingOrNull(SpvReflectDescriptorSet* a, uint32_t binding);
-void FreeUnionDescSet(SpvReflectDescriptorSet* a);
+
+struct DeadBindingReport {
+    uint32_t bindings = 0;    // Bindings dropped, or flagged partially bound
+    uint32_t descriptors = 0; // Sum of their descriptor counts
+    uint64_t bufferBytes = 0; // Uniform/storage block bytes that no longer need backing memory or writes
+};
+/**
+ * Applies mode to the bindings of set (built in arena) that no stage statically uses, tallying them in INOUT_report.
+ * DROP returns a new set without them, PARTIALLY_BOUND flags them in place, KEEP returns set untouched.
+ */
+SpvReflectDescriptorSet* EliminateDeadBindings(SpvReflectDescriptorSet* set, DeadBindingMode mode,
+                                               DescriptorSetArena& arena, DeadBindingReport& INOUT_report);
+/**
+ * Bindless mode: array bindings of set (built in arena) with at least minArraySize descriptors, and runtime arrays, get
+ * flagged PARTIALLY_BOUND and UPDATE_AFTER_BIND, so one set can stay bound for a whole frame while slots are filled in.
+ * Runtime arrays get descriptorCount descriptors, sized arrays keep the count the shader can index. The highest binding
+ * of the set also gets VARIABLE_DESCRIPTOR_COUNT.
+ * Uniform, dynamic and input attachment bindings are left alone. minArraySize 0 does nothing.
+ * @return How many bindings were made bindless
+ */
+uint32_t MakeBindlessBindings(SpvReflectDescriptorSet* set, uint32_t minArraySize, uint32_t descriptorCount,
+                              DescriptorSetArena& arena);
+/**
+ * Turns the uniform buffer bindings of set (built in arena) named in INOUT_unmatched (by instance or block type name)
+ * into UNIFORM_BUFFER_DYNAMIC ones, so a set written once can point at a new slice per draw through its dynamic offset.
+ * The shaders don't change, only the layout does. Names found are removed from INOUT_unmatched.
+ * @return How many bindings were made dynamic
+ */
+uint32_t MakeDynamicUniforms(SpvReflectDescriptorSet* set, std::unordered_set<std::string>& INOUT_unmatched,
+                             DescriptorSetArena& arena);
+/**
+ * Everything about set that ends up in its VkDescriptorSetLayout: the binding numbers, types, counts, stages and flags.
+ * Sets with the same key get identically defined, so compatible, layouts.
+ * @param layoutFlags see GetLayoutFlagsAsString
+ */
+std::string GetSetCompatibilityKey(const SpvReflectDescriptorSet* set, const DescriptorSetArena& arena,
+                                   const std::string& layoutFlags);
+/**
+ * Everything the class WriteDescSetLayout writes for set depends on, but its name: the binding numbers, types, counts,
+ * stages and flags, plus the binding and struct names the class exposes. Sets with the same key share one class.
+ * @param structs where the buffer structs of set were registered
+ * @param layoutFlags see GetLayoutFlagsAsString
+ */
+std::string GetSetLayoutKey(const SpvReflectDescriptorSet* set, const DescriptorSetArena& arena,
+                            const StructRegistry& structs, const std::string& layoutFlags);
+
+
+// THREADING
+uint32_t ResolveWorkerCount(uint32_t requested);
+/**
+ * Runs task(i) for every i in [0, count) across workerCount threads. Each worker starts with a contiguous slice
+ * of indices and steals from the others once its own slice runs dry. Tasks must only write to their own index.
+ */
+void ParallelForEachIndex(size_t count, uint32_t workerCount, const std::function<void(size_t)>& task);
+
+
+// CACHING
+// Bump whenever the generator changes what it writes for the same inputs, so stale caches get invalidated
+#define SHADERGEN_CACHE_VERSION 15
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+uint64_t HashString(const std::string& str, uint64_t seed = 0xcbf29ce484222325ull);
+uint64_t HashCombine(uint64_t seed, uint64_t value);
+/** Content hash of a file, false if it can't be read */
+bool HashFile(const std::string& path, uint64_t& outHash);
+
+/**
+ * Everything a generator run depends on, and everything it wrote, keyed by content hash.
+ * Persisted to OUT_DIR between runs so a run whose inputs and outputs are unchanged can be skipped entirely.
+ */
+struct GenerationCache {
+    uint32_t version = SHADERGEN_CACHE_VERSION;
+    uint64_t configHash = 0;
+    std::vector<std::pair<std::string, uint64_t>> stageHashes; // Unique stage files, in order of first reference
+    std::vector<std::pair<std::string, uint64_t>> outputHashes; // Generated files, relative to OUT_DIR
+};
+
+/** Also covers the options that change what gets generated */
+uint64_t HashGeneratorConfigs(const std::vector<GlobalDescriptorSet>& globalSetConfigs,
+                              const std::vector<PipelineConfig>& configs, const ShaderGenOptions& options);
+/** Hashes the configs and every unique stage file (in parallel), outputHashes is left empty */
+GenerationCache MakeGenerationCacheInputs(const std::vector<GlobalDescriptorSet>& globalSetConfigs,
+                                          const std::vector<PipelineConfig>& configs, const ShaderGenOptions& options);
+/** Fills outputHashes from the files as they are now on disk */
+void RecordGenerationCacheOutputs(GenerationCache& INOUT_cache, const std::vector<std::string>& outputFilenames);
+/** True if the inputs match and every output recorded in stored is still on disk, untouched */
+bool IsGenerationCacheUpToDate(const GenerationCache& current, const GenerationCache& stored);
+bool LoadGenerationCache(const std::string& path, GenerationCache& outCache);
+void SaveGenerationCache(const std::string& path, const GenerationCache& cache);
 
 
 // MODULES
-std::vector<std::pair<std::string, SpvReflectShaderModule *>>
-CreateAllReflectModules(const std::vector<PipelineConfig>& pipelines);
-SpvReflectShaderModule* MakeShaderModule(const std::string& filename);
-SpvReflectShaderModule* GetModule(const std::vector<std::pair<std::string, SpvReflectShaderModule *>>& modules, const std::string& key);
-void FreeReflectModules(std::vector<std::pair<std::string, SpvReflectShaderModule *>>& modules);
+/**
+ * Read-only words of a SPIR-V file. The file is mmap'd where the platform allows it and read into owned memory
+ * otherwise (or when mapping fails). Modules reflected with SPV_REFLECT_MODULE_FLAG_NO_COPY point straight into this,
+ * so it must outlive them.
+ */
+class SpirvFileMapping {
+public:
+    SpirvFileMapping() = default;
+    explicit SpirvFileMapping(const std::string& path);
+    ~SpirvFileMapping();
+    SpirvFileMapping(SpirvFileMapping&& other) noexcept;
+    SpirvFileMapping& operator=(SpirvFileMapping&& other) noexcept;
+    SpirvFileMapping(const SpirvFileMapping&) = delete;
+    SpirvFileMapping& operator=(const SpirvFileMapping&) = delete;
+
+    bool IsValid() const { return m_words != nullptr; }
+    bool IsMapped() const { return m_mapping != nullptr; }
+    const uint32_t* Words() const { return m_words; }
+    size_t ByteSize() const { return m_byteSize; }
+private:
+    bool ReadIntoMemory(const std::string& path);
+    void Release();
+
+    const uint32_t* m_words = nullptr;
+    size_t m_byteSize = 0;
+    void* m_mapping = nullptr;
+    std::vector<uint32_t> m_fallback;
+};
+
+/**
+ * Owns every reflected module of a run and indexes them, so lookups by filename and by (module, set) are hash lookups
+ * instead of scans. Only indexes sets that come straight from a module. Bindings are looked up within the set that
+ * holds them (see DescriptorSetUnion), which may be a union the database doesn't own.
+ */
+class ReflectionDatabase {
+public:
+    ReflectionDatabase() = default;
+    ~ReflectionDatabase();
+    ReflectionDatabase(const ReflectionDatabase&) = delete;
+    ReflectionDatabase& operator=(const ReflectionDatabase&) = delete;
+
+    /** Takes ownership of the module and of the code backing it */
+    void AddModule(const std::string& filename, SpvReflectShaderModule* module, SpirvFileMapping code);
+    SpvReflectShaderModule* GetModule(const std::string& filename) const;
+    SpvReflectDescriptorSet* GetDescSet(const SpvReflectShaderModule* module, uint32_t setID) const;
+    /** The words the module was reflected from, nullptr for unknown files */
+    const SpirvFileMapping* GetCode(const std::string& filename) const;
+    /**
+     * Changes the binding numbers of a set reflected from a module. Only the reflection data changes, the module's
+     * code is read-only, see WritePatchedShaderModules.
+     */
+    void RenumberBindings(SpvReflectDescriptorSet* set, const std::vector<std::pair<uint32_t, uint32_t>>& newByOldBinding);
+    size_t ModuleCount() const { return m_modules.size(); }
+private:
+    template <typename T>
+    struct KeyHash {
+        size_t operator()(const std::pair<const T*, uint32_t>& key) const {
+            return std::hash<const T*>()(key.first) ^ (std::hash<uint32_t>()(key.second) * 0x9e3779b97f4a7c15ull);
+        }
+    };
+
+    std::vector<SpvReflectShaderModule*> m_modules;
+    std::vector<SpirvFileMapping> m_moduleCode;
+    std::unordered_map<std::string, SpvReflectShaderModule*> m_modulesByFilename;
+    std::unordered_map<std::pair<const SpvReflectShaderModule*, uint32_t>, SpvReflectDescriptorSet*,
+            KeyHash<SpvReflectShaderModule>> m_setsByModule;
+};
+
+/**
+ * Reflects every unique stage file of the pipelines, in parallel, into INOUT_database. Modules are added in the order
+ * in which the files are first referenced by the pipelines, independent of the worker count.
+ */
+void CreateAllReflectModules(const std::vector<PipelineConfig>& pipelines, ReflectionDatabase& INOUT_database,
+                             uint32_t workerCount = 0);
+/**
+ * Reflects the file without copying its code, INOUT_code receives the backing words and must outlive the module.
+ */
+SpvReflectShaderModule* MakeShaderModule(const std::string& filename, SpirvFileMapping& INOUT_code);
+
+
+// COMPACTION
+/** Binding numbers of one set of one stage file, before and after compaction */
+struct ShaderBindingRemap {
+    std::string filename;
+    uint32_t setID;
+    std::vector<std::pair<uint32_t, uint32_t>> newByOldBinding; // Sorted by old binding
+};
+/**
+ * Renumbers the bindings of every merged set (global and per pipeline) densely, in binding order, and applies the
+ * numbering to every stage declaring the set. Bindings a stage declares but the merged set left out (dead bindings)
+ * are moved past the live ones. A stage file shared by sets that would number it differently keeps its numbers, and
+ * so do those sets, reported as an ERROR. The reflection data in INOUT_database is renumbered so generated headers
+ * agree, the returned remaps only cover stage files whose numbers changed.
+ */
+std::vector<ShaderBindingRemap> CompactBindings(const std::vector<PipelineConfig>& pipelines,
+                                                const std::vector<GlobalDescriptorSet>& globalSets,
+                                                const std::vector<std::array<SpvReflectDescriptorSet*, MAX_DESCRIPTOR_SETS>>& mergedSets,
+                                                ReflectionDatabase& INOUT_database);
+/**
+ * Writes a copy of every remapped stage file, renumbered through spvReflectChangeDescriptorBindingNumbers, to
+ * outDir (same filename). Returns the filenames written, relative to outDir.
+ */
+std::vector<std::string> WritePatchedShaderModules(const std::vector<ShaderBindingRemap>& remaps,
+                                                   const ReflectionDatabase& database, const std::string& outDir,
+                                                   uint32_t workerCount = 0);
+
+
+// LAYOUT COMPATIBILITY
+/** What decides whether the VkPipelineLayout of a pipeline is compatible with another one */
+struct PipelineLayoutSignature {
+    std::string pipelineName;
+    std::array<SpvReflectDescriptorSet*, MAX_DESCRIPTOR_SETS> sets{}; // Final merged sets, nullptr for unused set numbers
+    std::array<std::string, MAX_DESCRIPTOR_SETS> setKeys; // GetSetCompatibilityKey of each set, "" for unused set numbers
+    std::string pushConstantKey; // See GetPushConstantKey
+
+    /** setLayoutCount of the pipeline layout, one past the highest set number used */
+    uint32_t GetSetCount() const;
+};
+/** The ranges of merged, layouts are only compatible (for any set) with identical push constant ranges */
+std::string GetPushConstantKey(const MergedPushConstants& merged);
+/** Sets 0..n-1 that stay bound when switching from a pipeline with layout from to one with layout to */
+uint32_t CountCompatibleSets(const PipelineLayoutSignature& from, const PipelineLayoutSignature& to);
+/** Sets the pipeline of to uses that have to be bound again after switching to it from one with layout from */
+uint32_t CountRebinds(const PipelineLayoutSignature& from, const PipelineLayoutSignature& to);
+/**
+ * Lists the sets rebound at every pipeline switch of drawOrder (indices into signatures). Then proposes a draw order that
+ * keeps more sets bound, and the set merges and renumberings that would make more of the layouts compatible.
+ * @param outRebinds sets rebound over drawOrder
+ * @param outRecommendedRebinds the same for the proposed draw order
+ */
+std::string WriteLayoutCompatibilityReport(const std::vector<PipelineLayoutSignature>& signatures,
+                                           const std::vector<uint32_t>& drawOrder, uint32_t& outRebinds,
+                                           uint32_t& outRecommendedRebinds);
 
 
 // WORKING
 std::vector<std::array<SpvReflectDescriptorSet *, MAX_DESCRIPTOR_SETS>>
 MergeModulesUnionDescriptorSetsByPipeline(const std::vector<PipelineConfig> &pipelines,
-                                          const std::vector<std::pair<std::string, SpvReflectShaderModule *>> &modules);
-SpvReflectDescriptorSet* GetDescSetOf(uint32_t id, SpvReflectShaderModule* module);
+                                          const ReflectionDatabase &database, DescriptorSetArena &arena);
 void PopulateGlobalDescriptorLayouts(const std::vector<std::pair<uint32_t, SpvReflectDescriptorSet*>> &pipelineDescSetsAtGlobal,
-                                     std::vector<GlobalDescriptorSet>& INOUT_globalDescSets);
+                                     std::vector<GlobalDescriptorSet>& INOUT_globalDescSets, DescriptorSetArena &arena);
 
 
 
 // GENERATION
+/** MergePushConstants over every stage of config, false if they conflict */
+bool MergePipelinePushConstants(const PipelineConfig& config, const ReflectionDatabase& database,
+                                MergedPushConstants& outMerged);
+/**
+ * Push constant structs and ranges of every pipeline that has any, see WritePushConstants
+ * @return The names of all structs generated by this function and put into the file.
+ */
+std::unordered_set<std::string> GeneratePushConstantFile(const std::vector<PipelineConfig>& configs,
+                                                         const ReflectionDatabase& database, const std::string& filename);
+/**
+ * <name>_Pipeline of every pipeline, with its set layout types, push constant ranges, vertex input state, stages and a
+ * stable hash of all of them, and the PipelineManifest of every pipeline for WarmUpPipelines
+ * @param configs with the descSetManagerNames of every set, see GenerateMaterialDescriptorSetsFile
+ * @param signatures the final layout of every pipeline, parallel to configs
+ * @param stageHashes content hash of every stage file, see GenerationCache
+ * @param patchedShaderFiles the stage files compaction rewrote, see WritePatchedShaderModules
+ */
+void GeneratePipelineFile(const std::vector<PipelineConfig>& configs, const std::vector<PipelineLayoutSignature>& signatures,
+                          const ReflectionDatabase& database, const std::vector<std::pair<std::string, uint64_t>>& stageHashes,
+                          const std::vector<std::string>& patchedShaderFiles, const std::string& filename);
 void GenerateInputVariableFile(const std::vector<PipelineConfig> &configs,
-                               std::vector<std::pair<std::string, SpvReflectShaderModule *>> &modules,
+                               const ReflectionDatabase &database,
                                const std::string& filename);
 /**
  * Returns generated structs
- * @param globalConfigs
- * @param reflectedGlobalDescSets
+ * @param globalConfigs descSet already unioned over all pipelines, see PopulateGlobalDescriptorLayouts
+ * @param arena the arena the global sets were built in, provides their stage masks
  * @param filename
+ * @param framesInFlight copies of every set in its _Framed typedef
  * @return
  */
-std::vector<std::string> GenerateGlobalDescriptorSetsFile(std::vector<GlobalDescriptorSet> &globalConfigs,
-                                      const std::vector<std::pair<uint32_t, SpvReflectDescriptorSet *>> &reflectedGlobalDescSets,
-                                      const std::string& filename);
+std::unordered_set<std::string> GenerateGlobalDescriptorSetsFile(std::vector<GlobalDescriptorSet> &globalConfigs,
+                                      const DescriptorSetArena &arena,
+                                      const std::string& filename, uint32_t framesInFlight);
 /**
  * EXPECTS configs.size() == unionedDescSets.size()
  * @param configs
  * @param unionedDescSets
+ * @param arena the arena the unioned sets were built in, provides their stage masks
+ * @param framesInFlight copies of every set in its _Framed typedef
  * @return
  */
-std::vector<std::string>  GenerateMaterialDescriptorSetsFile(std::vector<PipelineConfig> &configs,
+std::unordered_set<std::string> GenerateMaterialDescriptorSetsFile(std::vector<PipelineConfig> &configs,
                                                              const std::vector<std::array<SpvReflectDescriptorSet *, 4>> &unionedDescSets,
-                                                             const std::string& filename);
+                                                             const DescriptorSetArena &arena,
+                                                             const std::string& filename, uint32_t framesInFlight);
 
 
 